@@ -0,0 +1,166 @@
+/**
+ * @file main.cpp
+ * @brief Control of the assembly with two tasks running as coroutines on a single thread (requires C++20)
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#include <iostream>
+
+#include "simulator.h"
+#include "coroutines.h"
+
+using namespace std;
+
+Signal piece_disponible;	// An object is waiting at the end of the supply conveyor
+Signal piece_prise;			// The robot took the object
+bool fin = false;
+
+/**
+ * @brief Supply conveyor control: run until an object reaches the optical barrier, then wait for the robot to take it
+ */
+Task tache_tapis1() {
+	while(not fin) {
+		sim.set_AV_T1(true);
+		co_await async_wait_co();
+		sim.set_AV_T1(false);
+
+		piece_disponible.notify();
+		co_await async_wait(piece_prise);
+	}
+}
+
+/**
+ * @brief Assembly operation
+ *
+ * @param op Operation number
+ */
+Task assembly(int op) {
+	sim.set_G(true);
+	co_await async_wait_pos_assem();
+	sim.set_G(false);
+
+	if(op==1) {
+		sim.set_OP1(true);
+		co_await async_wait_fin_OP1();
+		sim.set_OP1(false);
+	}
+	else if(op==2) {
+		sim.set_OP2(true);
+		co_await async_wait_fin_OP2();
+		sim.set_OP2(false);
+	}
+	else {
+		sim.set_OP3(true);
+		co_await async_wait_fin_OP3();
+		sim.set_OP3(false);
+		cout << "Verif=1" << endl;
+		sim.set_Verif(true);
+		co_await async_wait_assemblage_conforme();
+		sim.set_Verif(false);
+		cout << "Verif=0" << endl;
+		co_await async_wait_assemblage_evacue();
+		cout << "Assembly evacuated" << endl;
+	}
+	sim.set_D(true);
+	co_await async_wait_pos_t1();
+	sim.set_D(false);
+}
+
+/**
+ * @brief Evacuate the object
+ */
+Task evac() {
+	sim.set_D(true);
+	co_await async_wait_pos_t2();
+	sim.set_D(false);
+
+	sim.set_AV_T2(false);
+	co_await async_wait_arret_t2();
+
+	sim.set_Pose(true);
+	co_await async_wait_fpose();
+	sim.set_Pose(false);
+
+	sim.set_AV_T2(true);
+
+	sim.set_G(true);
+	co_await async_wait_pos_t1();
+	sim.set_G(false);
+}
+
+/**
+ * @brief Robot control: take the objects and assemble them
+ */
+Task tache_robot() {
+	int needed = 1;
+	int loops = 0;
+
+	sim.set_D(true);
+	co_await async_wait_pos_t1();
+	sim.set_D(false);
+
+	while(loops < 2) {
+		co_await async_wait(piece_disponible);
+
+		sim.set_Reccam(true);
+		co_await async_wait_fin_reccam();
+		sim.set_Reccam(false);
+
+		sim.set_Prend(true);
+		co_await async_wait_fprise();
+		sim.set_Prend(false);
+
+		bool p1 = sim.read_p1(), p2 = sim.read_p2(), p3 = sim.read_p3();
+		cout << "P1=" << p1 << ", P2=" << p2 << ", P3=" << p3 << endl;
+
+		if(needed==1 and p1) {
+			cout << "assembly op1" << endl;
+			co_await assembly(1);
+			needed = 2;
+		}
+		else if(needed==2 and p2) {
+			cout << "assembly op2" << endl;
+			co_await assembly(2);
+			needed = 3;
+		}
+		else if(needed==3 and p3) {
+			cout << "assembly op3" << endl;
+			co_await assembly(3);
+			needed = 1;
+			loops = loops+1;
+		}
+		else {
+			cout << "evac" << endl;
+			co_await evac();
+		}
+
+		fin = (loops >= 2);
+		piece_prise.notify();
+	}
+}
+
+/**
+ * @brief Main function, run the control tasks
+ *
+ * @param argc Not used
+ * @param argv[] Not used
+ *
+ * @return -1 in case of an error, 0 otherwise
+ */
+int main(int argc, char const *argv[])
+{
+	if(not sim.start(10)) {
+		return -1;
+	}
+
+	Executor executor;
+	executor.spawn(tache_tapis1());
+	executor.spawn(tache_robot());
+	executor.run();
+
+	sim.stop();
+
+	return 0;
+}
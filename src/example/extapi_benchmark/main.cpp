@@ -0,0 +1,546 @@
+/**
+ * @file main.cpp
+ * @brief Threads and CPU used by the remote API client for 1, 16 and 128 idle connections,
+ * then cost of reading streamed signals from the input buffer for 10, 100 and 500 signals,
+ * cost of merging replies holding 10 changed signals out of 100, 1000 and 10000,
+ * and bandwidth when sending and receiving 640x480 and 1920x1080 RGB images (Linux only).
+ * The thread count includes the main thread, and the allocations are the buffers allocated by the remote API during each measurement.
+ * The buffers are reused once the connections are settled, so the benchmark fails if any is allocated while measuring.
+ * Build with -DEXTAPI_EPOLL=ON and OFF to compare the single I/O thread with the one thread per connection implementation.
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern "C" {
+	#include "extApi.h"
+}
+
+using namespace std;
+
+const int first_port = 20100;
+
+// Number of requests answered and of bytes received by the server, shared with the benchmark process
+volatile unsigned long* requests;
+volatile unsigned long* received_bytes;
+
+/**
+ * @brief Build the reply to a streamed integer signal read
+ *
+ * @param name Name of the signal
+ * @param value Value of the signal
+ * @param message Where to append the reply
+ */
+void append_Signal(const string& name, simxInt value, vector<unsigned char>& message) {
+	vector<unsigned char> command(SIMX_SUBHEADER_SIZE + name.size() + 1 + sizeof(simxInt), 0);
+	*(simxInt*)&command[simx_cmdheaderoffset_mem_size] = command.size();
+	*(simxInt*)&command[simx_cmdheaderoffset_full_mem_size] = command.size();
+	*(simxUShort*)&command[simx_cmdheaderoffset_pdata_offset0] = name.size() + 1;
+	*(simxInt*)&command[simx_cmdheaderoffset_cmd] = simx_cmd_get_integer_signal + simx_opmode_streaming;
+	memcpy(&command[SIMX_SUBHEADER_SIZE], name.c_str(), name.size() + 1);
+	memcpy(&command[SIMX_SUBHEADER_SIZE + name.size() + 1], &value, sizeof(simxInt));
+	message.insert(message.end(), command.begin(), command.end());
+}
+
+/**
+ * @brief Build the reply to a streamed RGB vision sensor image read
+ *
+ * @param width Width of the image (pixels)
+ * @param height Height of the image (pixels)
+ * @param message Where to append the reply
+ */
+void append_Image(int width, int height, vector<unsigned char>& message) {
+	vector<unsigned char> command(SIMX_SUBHEADER_SIZE + sizeof(simxInt) + 2 * sizeof(simxInt) + width * height * 3, 0);
+	*(simxInt*)&command[simx_cmdheaderoffset_mem_size] = command.size();
+	*(simxInt*)&command[simx_cmdheaderoffset_full_mem_size] = command.size();
+	*(simxUShort*)&command[simx_cmdheaderoffset_pdata_offset0] = sizeof(simxInt);
+	*(simxInt*)&command[simx_cmdheaderoffset_cmd] = simx_cmd_get_vision_sensor_image_rgb + simx_opmode_streaming;
+	simxInt resolution[2] = {width, height};
+	memcpy(&command[SIMX_SUBHEADER_SIZE + sizeof(simxInt)], resolution, sizeof(resolution));
+	message.insert(message.end(), command.begin(), command.end());
+}
+
+/**
+ * @brief Send a message split into packets
+ *
+ * @param fd Socket
+ * @param message Message to send
+ */
+void send_Message(int fd, const vector<unsigned char>& message) {
+	vector<unsigned char> packets;
+	size_t offset = 0;
+	size_t packets_left = (message.size() + SOCKET_MAX_PACKET_SIZE - SOCKET_HEADER_LENGTH - 1) / (SOCKET_MAX_PACKET_SIZE - SOCKET_HEADER_LENGTH);
+	while(offset < message.size()) {
+		size_t size = min(message.size() - offset, size_t(SOCKET_MAX_PACKET_SIZE - SOCKET_HEADER_LENGTH));
+		simxShort header[3] = {1, simxShort(size), simxShort(--packets_left)};
+		packets.insert(packets.end(), (unsigned char*)header, (unsigned char*)header + SOCKET_HEADER_LENGTH);
+		packets.insert(packets.end(), &message[offset], &message[offset] + size);
+		offset += size;
+	}
+
+	offset = 0;
+	while(offset < packets.size()) {
+		ssize_t sent = send(fd, &packets[offset], packets.size() - offset, MSG_NOSIGNAL);
+		if(sent < 0) {
+			if(errno != EAGAIN)
+				return;
+			this_thread::yield();
+			continue;
+		}
+		offset += sent;
+	}
+}
+
+/**
+ * @brief Minimal remote API server, on one port per connection.
+ * Replies to each request with the value of some streamed integer signals, or with an empty message
+ *
+ * @param connections Number of ports to listen to
+ * @param signals Number of signals
+ * @param changed Number of signals in each reply after the first one, which holds them all (0 for all of them)
+ * @param width Width of the RGB image in each reply (0 for no image)
+ * @param height Height of the RGB image in each reply
+ */
+void run_Server(int connections, int signals, int changed = 0, int width = 0, int height = 0) {
+	int poller = epoll_create1(0);
+	vector<int> listeners;
+
+	for (int i = 0; i < connections; ++i) {
+		int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		int one = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = inet_addr("127.0.0.1");
+		address.sin_port = htons(first_port + i);
+		if(bind(listener, (sockaddr*)&address, sizeof(address)) != 0 or listen(listener, 4) != 0) {
+			cerr << "Can't listen to port " << first_port + i << endl;
+			exit(-1);
+		}
+
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = (uint64_t(1) << 32) | listener;
+		epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+		listeners.push_back(listener);
+	}
+
+	// Received data and message being received of each connection, and whether all the signals were sent to it already
+	vector<vector<unsigned char>> received(65536);
+	vector<vector<unsigned char>> messages(65536);
+	vector<bool> started(65536, false);
+	vector<unsigned char> buffer(65536);
+
+	epoll_event events[64];
+	for(;;) {
+		int count = epoll_wait(poller, events, 64, -1);
+		for (int i = 0; i < count; ++i) {
+			int fd = events[i].data.u64 & 0xffffffff;
+			if(events[i].data.u64 >> 32) {
+				int connection = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+				if(connection >= 0) {
+					epoll_event event;
+					event.events = EPOLLIN;
+					event.data.u64 = connection;
+					epoll_ctl(poller, EPOLL_CTL_ADD, connection, &event);
+				}
+				continue;
+			}
+
+			vector<unsigned char>& data = received[fd];
+			vector<unsigned char>& message = messages[fd];
+			ssize_t size = recv(fd, buffer.data(), buffer.size(), 0);
+			if(size <= 0) {
+				close(fd);
+				data.clear();
+				message.clear();
+				started[fd] = false;
+				continue;
+			}
+			data.insert(data.end(), buffer.begin(), buffer.begin() + size);
+			*received_bytes += size;
+
+			// Parse the complete packets: header (1, size, packets left) followed by the data
+			size_t offset = 0;
+			for(;;) {
+				if(data.size() - offset < SOCKET_HEADER_LENGTH)
+					break;
+				simxShort packet_size = ((simxShort*)&data[offset])[1];
+				simxShort packets_left = ((simxShort*)&data[offset])[2];
+				if(data.size() - offset < size_t(SOCKET_HEADER_LENGTH + packet_size))
+					break;
+				message.insert(message.end(), &data[offset + SOCKET_HEADER_LENGTH], &data[offset + SOCKET_HEADER_LENGTH] + packet_size);
+				offset += SOCKET_HEADER_LENGTH + packet_size;
+				if(packets_left == 0) {
+					// Reply with the request header followed by the signals
+					vector<unsigned char> reply(message.begin(), message.begin() + SIMX_HEADER_SIZE);
+					if(changed == 0 or not started[fd]) {
+						for (int j = 0; j < signals; ++j)
+							append_Signal("signal_" + to_string(j), *requests, reply);
+						started[fd] = true;
+					}
+					else {
+						for (int j = 0; j < changed; ++j)
+							append_Signal("signal_" + to_string((*requests * changed + j) % signals), *requests, reply);
+					}
+					if(width > 0)
+						append_Image(width, height, reply);
+					send_Message(fd, reply);
+					++*requests;
+					message.clear();
+				}
+			}
+			data.erase(data.begin(), data.begin() + offset);
+		}
+	}
+}
+
+/**
+ * @brief Get the number of threads of the current process
+ */
+int get_Thread_Count() {
+	ifstream status("/proc/self/status");
+	string line;
+	while(getline(status, line)) {
+		if(line.compare(0, 8, "Threads:") == 0)
+			return stoi(line.substr(8));
+	}
+	return -1;
+}
+
+/**
+ * @brief Get the CPU time (user + system) used by the current process
+ *
+ * @return CPU time (seconds)
+ */
+double get_CPU_Time() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+/**
+ * @brief Get the CPU time used by the calling thread
+ *
+ * @return CPU time (seconds)
+ */
+double get_Thread_CPU_Time() {
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Get the number of buffers allocated by the remote API so far
+ */
+int get_Allocation_Count() {
+	simxInt allocations, releases;
+	simxGetAllocationCounters(&allocations, &releases);
+	return allocations;
+}
+
+/**
+ * @brief Open connections to a local server and measure the resources used while they exchange empty messages
+ *
+ * @param connections Number of connections
+ * @return Number of buffers allocated while measuring
+ */
+int measure(int connections) {
+	pid_t server = fork();
+	if(server == 0) {
+		run_Server(connections, 0);
+		exit(0);
+	}
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	for (int i = 0; i < connections; ++i) {
+		if(simxStart((simxChar*)"127.0.0.1", first_port + i, true, true, 2000, 5) == -1) {
+			cerr << "Can't connect to port " << first_port + i << endl;
+			break;
+		}
+	}
+
+	// Let the connections settle down, then measure
+	this_thread::sleep_for(chrono::seconds(1));
+	const double duration = 3.;
+	double cpu_start = get_CPU_Time();
+	unsigned long requests_start = *requests;
+	int allocations_start = get_Allocation_Count();
+	this_thread::sleep_for(chrono::duration<double>(duration));
+	double cpu = get_CPU_Time() - cpu_start;
+	double rate = (*requests - requests_start) / duration;
+	int allocations = get_Allocation_Count() - allocations_start;
+
+	cout << connections << " connection(s):\t" << get_Thread_Count() << " thread(s),\tCPU " << 100. * cpu / duration << "%,\t" << rate << " requests/s,\t" << allocations << " allocation(s)" << endl;
+
+	simxFinish(-1);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	return allocations;
+}
+
+/**
+ * @brief Read streamed signals from the input buffer of a single connection and measure the time taken by each read,
+ * as well as the CPU used to merge the replies into the input buffer
+ *
+ * @param signals Number of streamed signals
+ * @return Number of buffers allocated while measuring
+ */
+int measure_Lookups(int signals) {
+	pid_t server = fork();
+	if(server == 0) {
+		run_Server(1, signals);
+		exit(0);
+	}
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	int client_id = simxStart((simxChar*)"127.0.0.1", first_port, true, true, 2000, 5);
+	if(client_id == -1) {
+		cerr << "Can't connect to port " << first_port << endl;
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+		return 0;
+	}
+
+	vector<string> names;
+	for (int i = 0; i < signals; ++i)
+		names.push_back("signal_" + to_string(i));
+
+	// Wait for the first values
+	simxInt value;
+	while(simxGetIntegerSignal(client_id, names.back().c_str(), &value, simx_opmode_buffer) != simx_return_ok)
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+	// CPU used by the communication thread alone
+	const double duration = 2.;
+	double cpu_start = get_CPU_Time();
+	int allocations_start = get_Allocation_Count();
+	this_thread::sleep_for(chrono::duration<double>(duration));
+	double cpu = get_CPU_Time() - cpu_start;
+	int allocations = get_Allocation_Count() - allocations_start;
+
+	// Read all the signals, as a control loop would do each cycle
+	// The thread CPU time excludes the time given to the communication thread and to the server
+	const int rounds = 200000 / signals;
+	unsigned long found = 0;
+	double start = get_Thread_CPU_Time();
+	for (int i = 0; i < rounds; ++i) {
+		for(auto& name : names)
+			found += simxGetIntegerSignal(client_id, name.c_str(), &value, simx_opmode_buffer) == simx_return_ok;
+	}
+	double read_time = (get_Thread_CPU_Time() - start) * 1e9 / (double(rounds) * signals);
+
+	cout << signals << " signal(s):\t" << read_time << " ns per read (" << found << " values read),\tcommunication thread CPU " << 100. * cpu / duration << "%,\t" << allocations << " allocation(s)" << endl;
+
+	simxFinish(client_id);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	return allocations;
+}
+
+/**
+ * @brief Stream many signals of which only a few change in each reply, and measure the CPU used by the communication thread to merge each reply into the input buffer
+ *
+ * @param signals Number of streamed signals
+ * @param changed Number of signals in each reply
+ * @return Number of buffers allocated while measuring
+ */
+int measure_Merges(int signals, int changed) {
+	pid_t server = fork();
+	if(server == 0) {
+		run_Server(1, signals, changed);
+		exit(0);
+	}
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	int client_id = simxStart((simxChar*)"127.0.0.1", first_port, true, true, 2000, 5);
+	if(client_id == -1) {
+		cerr << "Can't connect to port " << first_port << endl;
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+		return 0;
+	}
+
+	// Wait for the first values
+	simxInt value;
+	string last = "signal_" + to_string(signals - 1);
+	while(simxGetIntegerSignal(client_id, last.c_str(), &value, simx_opmode_buffer) != simx_return_ok)
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+	const double duration = 2.;
+	double cpu_start = get_CPU_Time();
+	unsigned long requests_start = *requests;
+	int allocations_start = get_Allocation_Count();
+	this_thread::sleep_for(chrono::duration<double>(duration));
+	double cpu = get_CPU_Time() - cpu_start;
+	unsigned long replies = *requests - requests_start;
+	int allocations = get_Allocation_Count() - allocations_start;
+
+	cout << signals << " signal(s), " << changed << " per reply:\t" << 1e6 * cpu / replies << " us of CPU per reply (" << replies / duration << " replies/s),\t" << allocations << " allocation(s)" << endl;
+
+	simxFinish(client_id);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+	return allocations;
+}
+
+/**
+ * @brief Send a large image to a local server at each request, and measure the bandwidth and the CPU used by the remote API to send it
+ *
+ * @param width Width of the RGB image (pixels)
+ * @param height Height of the RGB image (pixels)
+ */
+void measure_Bandwidth(int width, int height) {
+	pid_t server = fork();
+	if(server == 0) {
+		run_Server(1, 0);
+		exit(0);
+	}
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	int client_id = simxStart((simxChar*)"127.0.0.1", first_port, true, true, 2000, 5);
+	if(client_id == -1) {
+		cerr << "Can't connect to port " << first_port << endl;
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+		return;
+	}
+
+	vector<simxUChar> image(width * height * 3);
+	for (size_t i = 0; i < image.size(); ++i)
+		image[i] = i;
+
+	// Queue a new image as soon as the previous one has been sent
+	const double duration = 2.;
+	double cpu_start = get_CPU_Time();
+	unsigned long bytes_start = *received_bytes;
+	auto start = chrono::steady_clock::now();
+	while(chrono::steady_clock::now() - start < chrono::duration<double>(duration)) {
+		unsigned long requests_start = *requests;
+		simxSetVisionSensorImage(client_id, 0, image.data(), image.size(), 0, simx_opmode_oneshot);
+		while(*requests < requests_start + 2 and chrono::steady_clock::now() - start < chrono::duration<double>(duration))
+			this_thread::sleep_for(chrono::microseconds(100));
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double cpu = get_CPU_Time() - cpu_start;
+	double megabytes = (*received_bytes - bytes_start) / 1e6;
+
+	cout << width << "x" << height << " image:\t" << megabytes / elapsed << " MB/s,\t" << 1e3 * cpu / megabytes << " ms of CPU per MB sent" << endl;
+
+	simxFinish(client_id);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+}
+
+/**
+ * @brief Receive a large streamed image in each reply from a local server, and measure the bandwidth and the CPU used by the remote API to receive it
+ *
+ * @param width Width of the RGB image (pixels)
+ * @param height Height of the RGB image (pixels)
+ */
+void measure_Reply_Bandwidth(int width, int height) {
+	pid_t server = fork();
+	if(server == 0) {
+		run_Server(1, 0, 0, width, height);
+		exit(0);
+	}
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	int client_id = simxStart((simxChar*)"127.0.0.1", first_port, true, true, 2000, 5);
+	if(client_id == -1) {
+		cerr << "Can't connect to port " << first_port << endl;
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+		return;
+	}
+
+	// Wait for the first image
+	simxInt resolution[2];
+	simxUChar* image;
+	while(simxGetVisionSensorImage(client_id, 0, resolution, &image, 0, simx_opmode_buffer) != simx_return_ok)
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+	const double duration = 2.;
+	double cpu_start = get_CPU_Time();
+	unsigned long requests_start = *requests;
+	this_thread::sleep_for(chrono::duration<double>(duration));
+	double cpu = get_CPU_Time() - cpu_start;
+	double megabytes = (*requests - requests_start) * (width * height * 3.) / 1e6;
+
+	cout << width << "x" << height << " image replies:\t" << megabytes / duration << " MB/s,\t" << 1e3 * cpu / megabytes << " ms of CPU per MB received" << endl;
+
+	simxFinish(client_id);
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+}
+
+/**
+ * @brief Main function, run the benchmarks
+ *
+ * @param argc Not used
+ * @param argv[] Not used
+ *
+ * @return 0, 1 if buffers were allocated while measuring
+ */
+int main(int argc, char const *argv[])
+{
+#ifdef EXTAPI_EPOLL
+	cout << "Single I/O thread (EXTAPI_EPOLL)" << endl;
+#else
+	cout << "One thread per connection" << endl;
+#endif
+
+	requests = (unsigned long*)mmap(NULL, sizeof(unsigned long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	*requests = 0;
+	received_bytes = (unsigned long*)mmap(NULL, sizeof(unsigned long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	*received_bytes = 0;
+
+	int allocations = 0;
+	allocations += measure(1);
+	allocations += measure(16);
+	allocations += measure(128);
+
+	allocations += measure_Lookups(10);
+	allocations += measure_Lookups(100);
+	allocations += measure_Lookups(500);
+
+	allocations += measure_Merges(100, 10);
+	allocations += measure_Merges(1000, 10);
+	allocations += measure_Merges(10000, 10);
+
+	measure_Bandwidth(640, 480);
+	measure_Bandwidth(1920, 1080);
+
+	measure_Reply_Bandwidth(640, 480);
+	measure_Reply_Bandwidth(1920, 1080);
+
+	if(allocations != 0) {
+		cerr << allocations << " allocation(s) while measuring, the remote API buffers should have been reused" << endl;
+		return 1;
+	}
+
+	return 0;
+}
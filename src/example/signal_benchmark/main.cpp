@@ -0,0 +1,134 @@
+/**
+ * @file main.cpp
+ * @brief Wake up latency of the Signal class compared to a mutex + condition variable implementation
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "simulator.h"
+
+using namespace std;
+
+/**
+ * @brief Reference signal, using a mutex and a condition variable for every wait and notify
+ */
+class ConditionSignal
+{
+public:
+	ConditionSignal() : signaled_(false) {
+	}
+
+	void wait() {
+		unique_lock<mutex> lock(m_);
+		cv_.wait(lock, [this](){return signaled_;});
+		signaled_ = false;
+	}
+
+	void notify() {
+		lock_guard<mutex> lock(m_);
+		signaled_ = true;
+		cv_.notify_one();
+	}
+
+private:
+	mutex m_;
+	condition_variable cv_;
+	bool signaled_;
+};
+
+/**
+ * @brief Measure the round trip time of a signal exchanged back and forth between two threads
+ *
+ * @tparam SignalT Signal implementation to test
+ * @param count Number of round trips
+ *
+ * @return Mean round trip time (microseconds)
+ */
+template<typename SignalT>
+double ping_Pong(int count) {
+	SignalT ping, pong;
+
+	thread other([&](){
+		for (int i = 0; i < count; ++i) {
+			ping.wait();
+			pong.notify();
+		}
+	});
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i) {
+		ping.notify();
+		pong.wait();
+	}
+	auto end = chrono::steady_clock::now();
+
+	other.join();
+
+	return chrono::duration<double, micro>(end - start).count() / count;
+}
+
+/**
+ * @brief Measure the time needed to wake up a thread sleeping on a signal
+ *
+ * @tparam SignalT Signal implementation to test
+ * @param count Number of wake ups
+ *
+ * @return Mean wake up latency (microseconds)
+ */
+template<typename SignalT>
+double wake_Up(int count) {
+	SignalT signal, ack;
+	chrono::steady_clock::time_point notify_time;
+	double total = 0.;
+
+	thread waiter([&](){
+		for (int i = 0; i < count; ++i) {
+			signal.wait();
+			total += chrono::duration<double, micro>(chrono::steady_clock::now() - notify_time).count();
+			ack.notify();
+		}
+	});
+
+	for (int i = 0; i < count; ++i) {
+		// Let the waiter go to sleep
+		this_thread::sleep_for(chrono::microseconds(200));
+		notify_time = chrono::steady_clock::now();
+		signal.notify();
+		ack.wait();
+	}
+
+	waiter.join();
+
+	return total / count;
+}
+
+/**
+ * @brief Main function, run the benchmarks
+ *
+ * @param argc Not used
+ * @param argv[] Not used
+ *
+ * @return 0
+ */
+int main(int argc, char const *argv[])
+{
+	const int round_trips = 100000;
+	const int wake_ups = 2000;
+
+	cout << "Round trip (" << round_trips << " iterations)" << endl;
+	cout << "\tSignal:             " << ping_Pong<Signal>(round_trips) << "us" << endl;
+	cout << "\tcondition variable: " << ping_Pong<ConditionSignal>(round_trips) << "us" << endl;
+
+	cout << "Sleeping thread wake up (" << wake_ups << " iterations)" << endl;
+	cout << "\tSignal:             " << wake_Up<Signal>(wake_ups) << "us" << endl;
+	cout << "\tcondition variable: " << wake_Up<ConditionSignal>(wake_ups) << "us" << endl;
+
+	return 0;
+}
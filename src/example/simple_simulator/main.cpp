@@ -83,8 +83,7 @@ int main(int argc, char const *argv[])
     
         cout << "Reccam=1" << endl;
         simple_sim.set_Reccam(true);
-        while(not simple_sim.read_fin_reccam())
-            this_thread::sleep_for(std::chrono::milliseconds(10));
+        simple_sim.wait_fin_reccam();
         simple_sim.set_Reccam(false);
         cout << "Reccam=0" << endl;
     
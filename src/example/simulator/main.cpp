@@ -25,29 +25,24 @@ void assembly(int op) {
 
 	if(op==1) {
 		sim.set_OP1(true);
-		while(not sim.read_fin_OP1())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_fin_OP1();
 		sim.set_OP1(false);
 	}
 	else if(op==2) {
 		sim.set_OP2(true);
-		while(not sim.read_fin_OP2())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_fin_OP2();
 		sim.set_OP2(false);
 	}
 	else {
 		sim.set_OP3(true);
-		while(not sim.read_fin_OP3())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_fin_OP3();
 		sim.set_OP3(false);
 		cout << "Verif=1" << endl;
 		sim.set_Verif(true);
-		while(not sim.read_assemblage_conforme())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_assemblage_conforme();
 		sim.set_Verif(false);
 		cout << "Verif=0" << endl;
-		while(not sim.read_assemblage_evacue())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_assemblage_evacue();
 		cout << "Assembly evacuated" << endl;
 	}
 	sim.set_D(true);
@@ -68,11 +63,8 @@ void evac() {
 
 	sim.set_Pose(true);
 	sim.wait_fpose();
-	sim.set_Pose(false);
-
-	sim.set_AV_T2(true);
-
-	sim.set_G(true);
+	// Release the object, restart the evacuation conveyor and go back to the supply conveyor in one go
+	sim.apply({{Simulator::CmdPose, false}, {Simulator::CmdAV_T2, true}, {Simulator::CmdG, true}});
 	sim.wait_pos_t1();
 	sim.set_G(false);
 }
@@ -109,8 +101,7 @@ int main(int argc, char const *argv[])
 
 		cout << "Reccam=1" << endl;
 		sim.set_Reccam(true);
-		while(not sim.read_fin_reccam())
-			this_thread::sleep_for(std::chrono::milliseconds(10));
+		sim.wait_fin_reccam();
 		sim.set_Reccam(false);
 		cout << "Reccam=0" << endl;
 
@@ -120,19 +111,20 @@ int main(int argc, char const *argv[])
 		sim.set_Prend(false);
 		cout << "Prend=0" << endl;
 
-		cout << "P1=" << sim.read_p1() << ", P2=" << sim.read_p2() << ", P3=" << sim.read_p3() << endl;
+		Simulator::SensorsState state = sim.read_all();   // all the sensors at once, from the same cycle
+		cout << "P1=" << state.p1 << ", P2=" << state.p2 << ", P3=" << state.p3 << endl;
 
-		if(needed==1 and sim.read_p1()) {
+		if(needed==1 and state.p1) {
 			cout << "assembly op1" << endl;
 			assembly(1);
 			needed = 2;
 		}
-		else if(needed==2 and sim.read_p2()) {
+		else if(needed==2 and state.p2) {
 			cout << "assembly op2" << endl;
 			assembly(2);
 			needed = 3;
 		}
-		else if(needed==3 and sim.read_p3()) {
+		else if(needed==3 and state.p3) {
 			cout << "assembly op3" << endl;
 			assembly(3);
 			needed = 1;
@@ -20,21 +20,30 @@ enum EtatsTapis1 {
 };
 
 Signal demande_demarrage_tapis1;
+Signal demande_fin;
 
 void tache_tapis1() {
 	EtatsTapis1 etat = Tapis1EnMarche;
-	while(1) {
+	WaitSet attente_co({&sim.get_Signal(Simulator::SensorCO), &demande_fin});
+	WaitSet attente_demarrage({&demande_demarrage_tapis1, &demande_fin});
+	bool fin = false;
+
+	while(not fin) {
 		switch(etat) {
 		case Tapis1EnMarche:
 			sim.set_AV_T1(true);
-			sim.wait_co();                          // blocking call
-			etat = Tapis1Arrete;
+			if(attente_co.wait_any() == 0)                  // blocking call, until co or demande_fin
+				etat = Tapis1Arrete;
+			else
+				fin = true;
 			break;
 
 		case Tapis1Arrete:
 			sim.set_AV_T1(false);
-			if(demande_demarrage_tapis1.wait_for(10))       // blocking call (for 10ms)
+			if(attente_demarrage.wait_any() == 0)           // blocking call, until demande_demarrage_tapis1 or demande_fin
 				etat = Tapis1EnMarche;
+			else
+				fin = true;
 			break;
 		}
 	}
@@ -86,6 +95,9 @@ int main(int argc, char const *argv[])
 			// May create other threads here
 		}
 		else if(cmd == "end") {
+			demande_fin.notify();                       // Ask the tasks to end
+			if(ctrl_tapis1.joinable())
+				ctrl_tapis1.join();
 			sim.stop();
 			break;
 		}
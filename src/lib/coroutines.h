@@ -0,0 +1,606 @@
+/**
+ * @file coroutines.h
+ * @brief C++20 coroutine versions of the Signal and Simulator waits, and a single threaded Executor to run them
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#ifndef COROUTINES_H_
+#define COROUTINES_H_
+
+#if not defined(__cpp_impl_coroutine)
+#error "coroutines.h requires a compiler with C++20 coroutines support (-std=c++20)"
+#endif
+
+#include <coroutine>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+#include "simulator.h"
+
+class Executor;
+
+/**
+ * @brief Control task implemented as a coroutine, to be run by an Executor.
+ * Any function returning a Task and using co_await is such a coroutine.
+ * A task can also co_await another task, the awaiting task is resumed once the awaited one has finished.
+ */
+class Task
+{
+public:
+	struct promise_type;
+
+	/**
+	 * @brief Resume the awaiting task, if any, or tell the executor that the task has finished
+	 */
+	struct FinalAwaiter
+	{
+		bool await_ready() noexcept {
+			return false;
+		}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+		void await_resume() noexcept {
+		}
+	};
+
+	struct promise_type
+	{
+		std::coroutine_handle<> continuation;	/**< Task awaiting this one */
+		Executor* executor = nullptr;			/**< Executor running this task, if spawned */
+
+		Task get_return_object() {
+			return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+		FinalAwaiter final_suspend() noexcept {
+			return {};
+		}
+		void return_void() {
+		}
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+
+	Task(Task&& other) : handle_(other.handle_) {
+		other.handle_ = nullptr;
+	}
+
+	~Task() {
+		if(handle_)
+			handle_.destroy();
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	/**
+	 * @brief Give up the ownership of the coroutine
+	 *
+	 * @return The coroutine handle
+	 */
+	std::coroutine_handle<promise_type> release() {
+		std::coroutine_handle<promise_type> handle = handle_;
+		handle_ = nullptr;
+		return handle;
+	}
+
+	/***	Awaiting a task from another task	***/
+	bool await_ready() {
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+		handle_.promise().continuation = awaiting;
+		return handle_;
+	}
+
+	void await_resume() {
+	}
+
+private:
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {
+	}
+
+	std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @brief Run several Tasks on the calling thread. Tasks run until they co_await something that is not ready,
+ * the executor then sleeps until one of the awaited signals arrives or a timeout expires.
+ * The async_* awaitables can only be used by tasks run by an Executor.
+ */
+class Executor
+{
+public:
+	Executor() = default;
+
+	~Executor() {
+		for(auto task : tasks_)
+			task.destroy();
+	}
+
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	/**
+	 * @brief Add a task to the executor. It starts running with the next call to run()
+	 *
+	 * @param task The task to add
+	 */
+	void spawn(Task task) {
+		std::coroutine_handle<Task::promise_type> handle = task.release();
+		handle.promise().executor = this;
+		tasks_.push_back(handle);
+		ready_.push_back(handle);
+	}
+
+	/**
+	 * @brief Run the tasks until they all have finished (blocking call)
+	 */
+	void run() {
+		Executor* previous = current_;
+		current_ = this;
+
+		while(not tasks_.empty()) {
+			while(not ready_.empty()) {
+				std::coroutine_handle<> handle = ready_.front();
+				ready_.pop_front();
+				handle.resume();
+
+				for(auto task : finished_) {
+					tasks_.erase(std::find(tasks_.begin(), tasks_.end(), task));
+					task.destroy();
+				}
+				finished_.clear();
+			}
+
+			// Remaining tasks waiting for something else than a Signal or a timeout: nothing can wake them up
+			if(tasks_.empty() or waits_.empty())
+				break;
+
+			wait_Events();
+		}
+
+		current_ = previous;
+	}
+
+	/**
+	 * @brief Get the executor running on the calling thread
+	 *
+	 * @return The executor, nullptr if called outside of Executor::run()
+	 */
+	static Executor* current() {
+		return current_;
+	}
+
+	/**
+	 * @brief Suspend a task until a signal arrives or a timeout expires
+	 *
+	 * @param signal The signal to wait for, nullptr to only wait for the timeout
+	 * @param ms Timeout (milliseconds), infinite if negative
+	 * @param handle The task to resume
+	 * @param result Set to true if the signal arrived, false if the timeout expired. Can be nullptr
+	 * @param condition If set, checked each time the signal arrives, the task keeping waiting while it is false.
+	 * The result is then the value of the condition when the timeout expires
+	 */
+	void add_Wait(Signal* signal, int ms, std::coroutine_handle<> handle, bool* result, std::function<bool()> condition = nullptr) {
+		Wait wait;
+		wait.signal = signal;
+		wait.timed = ms >= 0;
+		wait.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms >= 0 ? ms : 0);
+		wait.handle = handle;
+		wait.result = result;
+		wait.condition = condition;
+		waits_.push_back(wait);
+	}
+
+private:
+	friend struct Task::FinalAwaiter;
+
+	struct Wait
+	{
+		Signal* signal;
+		bool timed;
+		std::chrono::steady_clock::time_point deadline;
+		std::coroutine_handle<> handle;
+		bool* result;
+		std::function<bool()> condition;
+	};
+
+	/**
+	 * @brief Tell if a task whose signal has arrived can be resumed
+	 */
+	static bool condition_Met(const Wait& wait) {
+		return not wait.condition or wait.condition();
+	}
+
+	/**
+	 * @brief Make a waiting task ready to run
+	 */
+	void wake_Up(std::list<Wait>::iterator wait, bool result) {
+		if(wait->result)
+			*wait->result = result;
+		ready_.push_back(wait->handle);
+		waits_.erase(wait);
+	}
+
+	/**
+	 * @brief Sleep until at least one waiting task can be resumed
+	 */
+	void wait_Events() {
+		while(ready_.empty()) {
+			auto now = std::chrono::steady_clock::now();
+			WaitSet signals;
+			std::vector<std::list<Wait>::iterator> signal_waits;
+			bool timed = false;
+			std::chrono::steady_clock::time_point deadline;
+
+			for(auto wait = waits_.begin(); wait != waits_.end(); ) {
+				auto current = wait++;
+				if(current->signal and current->signal->try_wait() and condition_Met(*current)) {
+					wake_Up(current, true);
+				}
+				else if(current->timed and current->deadline <= now) {
+					wake_Up(current, current->condition and current->condition());
+				}
+				else {
+					if(current->signal) {
+						signals.add(*current->signal);
+						signal_waits.push_back(current);
+					}
+					if(current->timed and (not timed or current->deadline < deadline)) {
+						deadline = current->deadline;
+						timed = true;
+					}
+				}
+			}
+
+			if(not ready_.empty())
+				break;
+
+			int ms = timed ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1 : -1;
+			if(signal_waits.empty()) {
+				std::this_thread::sleep_until(deadline);
+			}
+			else {
+				int index = signals.wait_any(ms);
+				if(index >= 0 and condition_Met(*signal_waits[index]))
+					wake_Up(signal_waits[index], true);
+			}
+		}
+	}
+
+	std::vector<std::coroutine_handle<>> tasks_;
+	std::vector<std::coroutine_handle<>> finished_;
+	std::deque<std::coroutine_handle<>> ready_;
+	std::list<Wait> waits_;
+
+	static inline thread_local Executor* current_ = nullptr;
+};
+
+inline std::coroutine_handle<> Task::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+	promise_type& promise = handle.promise();
+	if(promise.continuation)
+		return promise.continuation;
+	if(promise.executor)
+		promise.executor->finished_.push_back(handle);
+	return std::noop_coroutine();
+}
+
+/**
+ * @brief Awaitable returned by async_wait and async_wait_for
+ */
+class SignalAwaiter
+{
+public:
+	SignalAwaiter(Signal& signal, int ms) : signal_(signal), ms_(ms), result_(false) {
+	}
+
+	bool await_ready() {
+		result_ = signal_.try_wait();
+		return result_;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		Executor::current()->add_Wait(&signal_, ms_, handle, &result_);
+	}
+
+	bool await_resume() {
+		return result_;
+	}
+
+private:
+	Signal& signal_;
+	int ms_;
+	bool result_;
+};
+
+/**
+ * @brief Awaitable returned by the waits on a status level (async_wait_fin_reccam...).
+ * Like the Simulator waits, it completes at once if the status already has the expected level, otherwise the level is checked again each time its edge signal arrives
+ */
+class StatusAwaiter
+{
+public:
+	StatusAwaiter(Simulator& simulator, bool (Simulator::*read)(), bool state, Signal& edge, int ms) :
+		simulator_(simulator), read_(read), state_(state), edge_(edge), ms_(ms), result_(false) {
+	}
+
+	bool await_ready() {
+		result_ = level_Reached();
+		return result_;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		Executor::current()->add_Wait(&edge_, ms_, handle, &result_, [this]() { return level_Reached(); });
+	}
+
+	bool await_resume() {
+		return result_;
+	}
+
+private:
+	bool level_Reached() {
+		return (simulator_.*read_)() == state_;
+	}
+
+	Simulator& simulator_;
+	bool (Simulator::*read_)();
+	bool state_;
+	Signal& edge_;
+	int ms_;
+	bool result_;
+};
+
+/**
+ * @brief Awaitable returned by async_sleep_for
+ */
+class SleepAwaiter
+{
+public:
+	explicit SleepAwaiter(int ms) : ms_(ms) {
+	}
+
+	bool await_ready() {
+		return ms_ <= 0;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		Executor::current()->add_Wait(nullptr, ms_, handle, nullptr);
+	}
+
+	void await_resume() {
+	}
+
+private:
+	int ms_;
+};
+
+/**
+ * @brief Wait for a signal to come (co_await inside a Task)
+ * @param signal The signal to wait for
+ * @return An awaitable giving true once the signal has arrived
+ */
+inline SignalAwaiter async_wait(Signal& signal) {
+	return SignalAwaiter(signal, -1);
+}
+
+/**
+ * @brief Wait for a signal to come for a certain amount of time (co_await inside a Task)
+ * @param signal The signal to wait for
+ * @param ms Number of milliseconds to wait before returning
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_for(Signal& signal, int ms) {
+	return SignalAwaiter(signal, ms);
+}
+
+/**
+ * @brief Suspend the task for a certain amount of time (co_await inside a Task)
+ * @param ms Number of milliseconds to sleep
+ * @return An awaitable
+ */
+inline SleepAwaiter async_sleep_for(int ms) {
+	return SleepAwaiter(ms);
+}
+
+/**
+ * @brief Wait for the CO signal (optical barrier) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_co(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorCO), msec);
+}
+
+/**
+ * @brief Wait for the fprise signal (object took by the robot) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_fprise(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorFprise), msec);
+}
+
+/**
+ * @brief Wait for the fpose signal (object put down by the robot) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_fpose(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorFpose), msec);
+}
+
+/**
+ * @brief Wait for the pos_t1 signal (robot over supply conveyor) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_pos_t1(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorPosT1), msec);
+}
+
+/**
+ * @brief Wait for the pos_t2 signal (robot over evacuation conveyor) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_pos_t2(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorPosT2), msec);
+}
+
+/**
+ * @brief Wait for the pos_assem signal (robot over assembly station) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_pos_assem(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorPosAssem), msec);
+}
+
+/**
+ * @brief Wait for the arret_t2 signal (evacuation conveyor stopped) (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal has arrived during the timeout period, false otherwise
+ */
+inline SignalAwaiter async_wait_arret_t2(int msec = -1, Simulator& simulator = sim) {
+	return SignalAwaiter(simulator.get_Signal(Simulator::SensorArretT2), msec);
+}
+
+/**
+ * @brief Wait for the fin_reccam signal (end of object recognition) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_reccam(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_reccam, true, simulator.get_Signal(Simulator::SensorFinReccam), msec);
+}
+
+/**
+ * @brief Wait for the fin_reccam signal (end of object recognition) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_reccam_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_reccam, false, simulator.get_Signal(Simulator::SensorFinReccamFalling), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP1 signal (assembly operation 1 finished) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP1(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP1, true, simulator.get_Signal(Simulator::SensorFinOP1), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP1 signal (assembly operation 1 finished) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP1_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP1, false, simulator.get_Signal(Simulator::SensorFinOP1Falling), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP2 signal (assembly operation 2 finished) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP2(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP2, true, simulator.get_Signal(Simulator::SensorFinOP2), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP2 signal (assembly operation 2 finished) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP2_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP2, false, simulator.get_Signal(Simulator::SensorFinOP2Falling), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP3 signal (assembly operation 3 finished) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP3(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP3, true, simulator.get_Signal(Simulator::SensorFinOP3), msec);
+}
+
+/**
+ * @brief Wait for the fin_OP3 signal (assembly operation 3 finished) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_fin_OP3_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_fin_OP3, false, simulator.get_Signal(Simulator::SensorFinOP3Falling), msec);
+}
+
+/**
+ * @brief Wait for the assemblage_conforme signal (good assembly) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_assemblage_conforme(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_assemblage_conforme, true, simulator.get_Signal(Simulator::SensorAssemblageConforme), msec);
+}
+
+/**
+ * @brief Wait for the assemblage_conforme signal (good assembly) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_assemblage_conforme_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_assemblage_conforme, false, simulator.get_Signal(Simulator::SensorAssemblageConformeFalling), msec);
+}
+
+/**
+ * @brief Wait for the assemblage_evacue signal (evacuated assembly) to be set (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is set, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_assemblage_evacue(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_assemblage_evacue, true, simulator.get_Signal(Simulator::SensorAssemblageEvacue), msec);
+}
+
+/**
+ * @brief Wait for the assemblage_evacue signal (evacuated assembly) to be reset (co_await inside a Task)
+ * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+ * @param simulator The simulator to use
+ * @return An awaitable giving true is the signal is reset, false if the timeout period has expired
+ */
+inline StatusAwaiter async_wait_assemblage_evacue_falling(int msec = -1, Simulator& simulator = sim) {
+	return StatusAwaiter(simulator, &Simulator::read_assemblage_evacue, false, simulator.get_Signal(Simulator::SensorAssemblageEvacueFalling), msec);
+}
+
+#endif
@@ -22,9 +22,9 @@ extern "C" {
 
 using namespace std;
 
-SimpleSimulator::SimpleSimulator() : 
-	next_OP_(1),
-	Simulator()
+SimpleSimulator::SimpleSimulator(const std::string& address, int port) :
+	Simulator(address, port),
+	next_OP_(1)
 {
 }
 
@@ -66,35 +66,28 @@ void SimpleSimulator::set_OP(bool state) {
 	switch(next_OP_) {
 		case 1:
 			set_OP1(state);
-			if(state) {
-				while(not read_fin_OP1())
-					this_thread::sleep_for(std::chrono::milliseconds(10));
-			}
+			if(state)
+				wait_fin_OP1();
 			else
 				next_OP_ = 2;
 		break;
 		case 2:
 			set_OP2(state);
-			if(state) {
-				while(not read_fin_OP2())
-					this_thread::sleep_for(std::chrono::milliseconds(10));
-			}
+			if(state)
+				wait_fin_OP2();
 			else
 				next_OP_ = 3;
 		break;
 		case 3:
 			set_OP3(state);
 			if(state) {
-				while(not read_fin_OP3())
-					this_thread::sleep_for(std::chrono::milliseconds(10));
+				wait_fin_OP3();
 
-				simple_sim.set_Verif(true);
-		        while(not simple_sim.read_assemblage_conforme())
-		            this_thread::sleep_for(std::chrono::milliseconds(10));
+				set_Verif(true);
+				wait_assemblage_conforme();
 
-				simple_sim.set_Verif(false);
-				while(not simple_sim.read_assemblage_evacue())
-					this_thread::sleep_for(std::chrono::milliseconds(10));
+				set_Verif(false);
+				wait_assemblage_evacue();
 			}
 			else
 				next_OP_ = 1;
@@ -20,7 +20,11 @@
 class SimpleSimulator : public Simulator
 {
 public:
-	SimpleSimulator();
+	/**
+	 * @param address IP address of the V-REP remote API server
+	 * @param port Port of the V-REP remote API server
+	 */
+	SimpleSimulator(const std::string& address = "127.0.0.1", int port = 19997);
 	~SimpleSimulator();
 
 	SimpleSimulator(const SimpleSimulator& sim) {
@@ -13,9 +13,17 @@
 #include <thread>
 
 #include <cstring>
+#include <algorithm>
+#include <climits>
 #include <time.h>
 #include <sys/time.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 extern "C" {
 	#include "extApi.h"
 }
@@ -24,81 +32,485 @@ using namespace std;
 
 #define LAZY_MODE 0
 
-Signal::Signal() : signaled_(false)
+// Period at which all the commands are sent in DeltaCommands mode (seconds)
+#define COMMANDS_REFRESH_PERIOD 1.
+
+// Maximum time to wait for the object handles and the first sensor values at startup (milliseconds)
+#define STARTUP_TIMEOUT_MS 5000
+
+// V-REP signal names, indexed by Simulator::Command
+static const char* command_signal_names[] = {
+	"appro_conveyor_command",
+	"evac_conveyor_command",
+	"reccam",
+	"go_right",
+	"go_left",
+	"take",
+	"put_down",
+	"OP1",
+	"OP2",
+	"OP3",
+	"verif"
+};
+
+// Spin iterations bounds for Signal waiters
+#define SIGNAL_MIN_SPIN 16
+#define SIGNAL_MAX_SPIN 4096
+
+// Signal state word layout
+#define SIGNALED		1
+#define WAITER			2
+
+static inline void cpu_Relax() {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// simxStart and simxFinish share the extApi connection slots between all the simulators
+static std::mutex connections_mutex;
+
+Signal::Signal() : state_(0), spin_count_(SIGNAL_MIN_SPIN), watcher_count_(0)
 {
 }
 
-void Signal::wait() {
+bool Signal::try_wait() {
+	int state = state_.load();
+	while(state & SIGNALED) {
+		if(state_.compare_exchange_weak(state, state & ~SIGNALED))
+			return true;
+	}
+	return false;
+}
+
+bool Signal::spin() {
+	// Spinning is pointless if the notifying thread can't run meanwhile
+	static const bool multi_core = thread::hardware_concurrency() > 1;
+	if(not multi_core)
+		return try_wait();
+
+	int spin_count = spin_count_.load(std::memory_order_relaxed);
+	for (int i = 0; i < spin_count; ++i) {
+		if(try_wait()) {
+			// Spinning was useful, allow longer spins next time
+			spin_count_.store(std::min(spin_count * 2, SIGNAL_MAX_SPIN), std::memory_order_relaxed);
+			return true;
+		}
+		cpu_Relax();
+	}
+	spin_count_.store(std::max(spin_count / 2, SIGNAL_MIN_SPIN), std::memory_order_relaxed);
+	return false;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief Sleep on a futex word as long as it holds the expected value
+ */
+static void futex_Wait(std::atomic<int>& word, int value, int ms) {
+	static_assert(sizeof(std::atomic<int>) == sizeof(int), "std::atomic<int> can't be used as a futex");
+
+	struct timespec timeout;
+	if(ms >= 0) {
+		timeout.tv_sec = ms / 1000;
+		timeout.tv_nsec = (ms % 1000) * 1000000L;
+	}
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, value, ms >= 0 ? &timeout : NULL, NULL, 0);
+}
+
+/**
+ * @brief Wake up to count threads sleeping on a futex word
+ */
+static void futex_Wake(std::atomic<int>& word, int count) {
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+void Signal::park(int state, int ms) {
+	futex_Wait(state_, state, ms);
+}
+
+void Signal::unpark() {
+	futex_Wake(state_, 1);
+}
+
+void BroadcastSignal::park(int generation, int ms) {
+	futex_Wait(generation_, generation, ms);
+}
+
+void BroadcastSignal::unpark() {
+	futex_Wake(generation_, INT_MAX);
+}
+
+#else
+
+void Signal::park(int state, int ms) {
 	std::unique_lock<std::mutex> lock(m_);
-	cv_.wait(lock, [this](){return signaled_.load();});
-	signaled_.store(false);
+	if(state_.load() != state)
+		return;
+	if(ms >= 0)
+		cv_.wait_for(lock, std::chrono::milliseconds(ms));
+	else
+		cv_.wait(lock);
 }
 
-bool Signal::wait_for(int ms) {
+void Signal::unpark() {
+	std::lock_guard<std::mutex> lock(m_);
+	cv_.notify_one();
+}
+
+void BroadcastSignal::park(int generation, int ms) {
 	std::unique_lock<std::mutex> lock(m_);
-	if(cv_.wait_for(lock, std::chrono::milliseconds(ms), [this](){return signaled_.load();})) {
-		signaled_.store(false);
-		return true;
+	if(generation_.load() != generation)
+		return;
+	if(ms >= 0)
+		cv_.wait_for(lock, std::chrono::milliseconds(ms));
+	else
+		cv_.wait(lock);
+}
+
+void BroadcastSignal::unpark() {
+	std::lock_guard<std::mutex> lock(m_);
+	cv_.notify_all();
+}
+
+#endif
+
+void Signal::wait() {
+	if(spin())
+		return;
+
+	state_ += WAITER;
+	for(;;) {
+		int state = state_.load();
+		if(state & SIGNALED) {
+			// Consume the signal and unregister as a waiter at once
+			if(state_.compare_exchange_weak(state, (state & ~SIGNALED) - WAITER))
+				return;
+		}
+		else {
+			park(state, -1);
+		}
 	}
-	else {
-		return false;
+}
+
+bool Signal::wait_for(int ms) {
+	if(spin())
+		return true;
+
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+
+	state_ += WAITER;
+	for(;;) {
+		int state = state_.load();
+		if(state & SIGNALED) {
+			if(state_.compare_exchange_weak(state, (state & ~SIGNALED) - WAITER))
+				return true;
+		}
+		else {
+			auto now = chrono::steady_clock::now();
+			if(now >= deadline) {
+				state_ -= WAITER;
+				return false;
+			}
+			park(state, chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1);
+		}
 	}
 }
 
 void Signal::notify() {
-	signaled_.store(true);
-	cv_.notify_one();
+	int state = state_.fetch_or(SIGNALED);
+	if(state >= WAITER)
+		unpark();
+	if(watcher_count_.load() > 0) {
+		std::lock_guard<std::mutex> lock(watchers_mutex_);
+		for(BroadcastSignal* watcher : watchers_)
+			watcher->notify();
+	}
 }
 
+void Signal::watch(BroadcastSignal& watcher) {
+	std::lock_guard<std::mutex> lock(watchers_mutex_);
+	watchers_.push_back(&watcher);
+	++watcher_count_;
+}
 
+void Signal::unwatch(BroadcastSignal& watcher) {
+	std::lock_guard<std::mutex> lock(watchers_mutex_);
+	watchers_.erase(std::find(watchers_.begin(), watchers_.end(), &watcher));
+	--watcher_count_;
+}
 
-Simulator::Simulator() :
-	client_id_(-1),
-	run_(false),
+
+BroadcastSignal::BroadcastSignal() : generation_(0), waiters_(0)
+{
+}
+
+unsigned int BroadcastSignal::generation() const {
+	return generation_.load();
+}
+
+bool BroadcastSignal::notified_since(unsigned int generation) const {
+	return BroadcastSignal::generation() != generation;
+}
+
+void BroadcastSignal::wait() {
+	wait(generation());
+}
+
+bool BroadcastSignal::wait_for(int ms) {
+	return wait_for(ms, generation());
+}
+
+void BroadcastSignal::wait(unsigned int generation) {
+	++waiters_;
+	int current;
+	while((current = generation_.load()) == int(generation))
+		park(current, -1);
+	--waiters_;
+}
+
+bool BroadcastSignal::wait_for(int ms, unsigned int generation) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+
+	++waiters_;
+	int current;
+	while((current = generation_.load()) == int(generation)) {
+		auto now = chrono::steady_clock::now();
+		if(now >= deadline)
+			break;
+		park(current, chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1);
+	}
+	--waiters_;
+
+	return current != int(generation);
+}
+
+void BroadcastSignal::notify() {
+	++generation_;
+	if(waiters_.load() > 0)
+		unpark();
+}
+
+WaitSet::WaitSet() :
+	next_(0)
+{
+}
+
+WaitSet::WaitSet(std::initializer_list<Signal*> signals) :
+	signals_(signals),
+	next_(0)
+{
+}
+
+int WaitSet::add(Signal& signal) {
+	signals_.push_back(&signal);
+	return signals_.size() - 1;
+}
+
+int WaitSet::wait_any(int ms) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+	int index = -1;
+
+	// Notified by the signals of the set only, so that the WaitSet can check them again
+	BroadcastSignal activity;
+	for(Signal* signal : signals_)
+		signal->watch(activity);
+
+	while(index < 0) {
+		unsigned int generation = activity.generation();
+
+		// Start after the last signal received so that a frequent one can't hide the others
+		for (size_t i = 0; i < signals_.size(); ++i) {
+			size_t idx = (next_ + i) % signals_.size();
+			if(signals_[idx]->try_wait()) {
+				index = idx;
+				next_ = idx + 1;
+				break;
+			}
+		}
+
+		if(index < 0) {
+			if(ms < 0) {
+				activity.wait(generation);
+			}
+			else {
+				auto now = chrono::steady_clock::now();
+				if(now >= deadline)
+					break;
+				activity.wait_for(chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1, generation);
+			}
+		}
+	}
+
+	for(Signal* signal : signals_)
+		signal->unwatch(activity);
+
+	return index;
+}
+
+bool WaitSet::wait_all(int ms) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(ms);
+	std::vector<bool> received(signals_.size(), false);
+	size_t remaining = signals_.size();
+
+	BroadcastSignal activity;
+	for(Signal* signal : signals_)
+		signal->watch(activity);
+
+	while(remaining > 0) {
+		unsigned int generation = activity.generation();
+
+		for (size_t i = 0; i < signals_.size(); ++i) {
+			if(not received[i] and signals_[i]->try_wait()) {
+				received[i] = true;
+				--remaining;
+			}
+		}
+
+		if(remaining > 0) {
+			if(ms < 0) {
+				activity.wait(generation);
+			}
+			else {
+				auto now = chrono::steady_clock::now();
+				if(now >= deadline)
+					break;
+				activity.wait_for(chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1, generation);
+			}
+		}
+	}
+
+	for(Signal* signal : signals_)
+		signal->unwatch(activity);
+
+	if(remaining > 0) {
+		// Give back the signals already consumed
+		for (size_t i = 0; i < signals_.size(); ++i) {
+			if(received[i])
+				signals_[i]->notify();
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+Simulator::Simulator(const std::string& address, int port) :
 	prev_position_(PosAssembly),
 	prev_gripper_state_(0),
 	prev_optical_barrier_state_(0),
 	prev_evac_conveyor_state_(1),
+	has_next_object_(false),
+	supply_running_(false),
 	last_created_object_time_(0),
-	last_created_object_type_(0)
+	run_(false),
+	options_(0),
+	last_sent_commands_(0),
+	last_commands_refresh_time_(0),
+	client_id_(-1),
+	address_(address),
+	port_(port)
 {
-	memset(&commands_, 0, sizeof(commands_t));
+#if LAZY_MODE
+	workload_ = std::make_shared<RoundRobinWorkload>();
+#else
+	workload_ = std::make_shared<MarkovWorkload>();
+#endif
+
+	commands_.store(0);
+	has_overflow_change_ = false;
+	has_next_change_ = false;
+	queued_commands_ = 0;
+	memset(&stats_, 0, sizeof(TransmissionStats));
+	memset(&connection_stats_, 0, sizeof(ConnectionStats));
+	connection_id_ = -1;
+	resyncing_ = false;
+
+	status_.store(0);
 
 	set_AV_T1(true);
 	set_AV_T2(true);
 }
 
 Simulator::~Simulator() {
-
+	stop();
 }
 
-bool Simulator::start(int cycle_ms) {
-	client_id_ = simxStart((simxChar*)"127.0.0.1",19997,true,true,2000,5);
+bool Simulator::start(int cycle_ms, int options) {
+	auto start_time = chrono::steady_clock::now();
+	auto elapsed = [start_time]() { return chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count(); };
+
+	options_ = options;
+	last_commands_refresh_time_ = -COMMANDS_REFRESH_PERIOD;
+
+	// Start the queue from the current commands, the changes made before are already in them
+	flush_Queued_Commands();
+
+	memset(&stats_, 0, sizeof(TransmissionStats));
+	memset(&startup_stats_, 0, sizeof(StartupStats));
+	memset(&connection_stats_, 0, sizeof(ConnectionStats));
+
+	{
+		std::lock_guard<std::mutex> lock(connections_mutex);
+		// The connection is restored in the background if lost, see check_Connection
+		client_id_ = simxStart((simxChar*)address_.c_str(),port_,true,false,2000,5);
+	}
 	if (client_id_ != -1) {
-		cout << "Connected to V-REP" << endl;
+		startup_stats_.connection = elapsed();
+		connection_id_ = simxGetConnectionId(client_id_);
+		resyncing_ = false;
+		cout << "Connected to V-REP (" << address_ << ":" << port_ << ")" << endl;
+
+		// Always get notified of the incoming messages during the startup, to know when the first values arrive
+		simxSetInMessageCallback(client_id_, &Simulator::message_Received, this);
+
+		// Nothing waits for a reply here: the requests are sent together and the replies checked by wait_Ready
+		simxPauseCommunication(client_id_, 1);
+		request_Handles();
+		bool streaming = start_Streaming();
+		if(options_ & Synchronous) {
+			if(cycle_ms == 0)
+				simxSetBooleanParameter(client_id_, sim_boolparam_realtime_simulation, false, simx_opmode_oneshot);
+		}
+		else {
+			simxStartSimulation(client_id_, simx_opmode_oneshot);
+		}
+		simxPauseCommunication(client_id_, 0);
 
-		if(not get_Handles()) {
-			cout << "Failed to get object handles" << endl;
+		if(not streaming) {
+			cout << "Starting streaming values failed" << endl;
+			close_Connection();
 			return false;
 		}
 
-		if(not start_Streaming()) {
-			cout << "Starting streaming values failed" << endl;
+		if(options_ & Synchronous) {
+			// Always blocking, and it must be enabled before the simulation starts
+			simxSynchronous(client_id_, true);
+			simxStartSimulation(client_id_, simx_opmode_oneshot);
+		}
+
+		if(not wait_Ready(start_time, STARTUP_TIMEOUT_MS)) {
+			close_Connection();
 			return false;
 		}
 
-		simxStartSimulation(client_id_, simx_opmode_oneshot_wait);
+		if(not (options_ & EventDriven))
+			simxSetInMessageCallback(client_id_, NULL, NULL);
 
 		cout << "Simulation started" << endl;
 
-		this_thread::sleep_for(std::chrono::seconds(1));
-
 		run_ = true;
 		thread_ = thread(&Simulator::process, this, cycle_ms);
+
+		startup_stats_.total = elapsed();
+		cout << "Startup: connection " << startup_stats_.connection << "ms, handles " << startup_stats_.handles << "ms, first values " << startup_stats_.first_values << "ms, total " << startup_stats_.total << "ms" << endl;
 	}
 	else {
-		cerr << "Can't connect to V-REP" << endl;
-		simxFinish(client_id_);
+		// simxStart has already released the connection, and simxFinish(-1) would close the ones of the other simulators
+		cerr << "Can't connect to V-REP (" << address_ << ":" << port_ << ")" << endl;
 		return false;
 	}
 
@@ -111,92 +523,543 @@ void Simulator::stop() {
 		thread_.join();
 	}
 
+	// Nothing takes the changes made from now on, don't keep the ones left
+	flush_Queued_Commands();
+
 	if(client_id_ >= 0) {
-		simxStopSimulation(client_id_, simx_opmode_oneshot_wait);
-		simxFinish(client_id_);
+		close_Connection();
 		cout << "Simulation ended" << endl;
 	}
 }
 
-bool Simulator::get_Handles() {
-	int ret_code = simxGetObjectHandle(client_id_, "appro_proximity_sensor#", &appro_prox_sensor_handle_, simx_opmode_oneshot_wait);
-	if(ret_code != simx_return_ok) {
-		cout << "can't get appro_proximity_sensor handle (error " << ret_code << ")" << endl;
-		return false;
+void Simulator::close_Connection() {
+	if(client_id_ < 0)
+		return;
+
+	simxSetInMessageCallback(client_id_, NULL, NULL);
+	simxStopSimulation(client_id_, simx_opmode_oneshot_wait);
+	{
+		std::lock_guard<std::mutex> lock(connections_mutex);
+		simxFinish(client_id_);
 	}
+	client_id_ = -1;
+}
 
-	return true;
+void Simulator::request_Handles() {
+	simxGetObjectHandle(client_id_, "appro_proximity_sensor#", &appro_prox_sensor_handle_, simx_opmode_oneshot);
+}
+
+int Simulator::read_Handles() {
+	return simxGetObjectHandle(client_id_, "appro_proximity_sensor#", &appro_prox_sensor_handle_, simx_opmode_buffer);
 }
 
 bool Simulator::start_Streaming() {
 	simxInt tmp;
 	bool all_ok = true;
 
-	all_ok &= ((simxGetIntegerSignal(client_id_, "optical_barrier_state",   &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "gripper_closed",          &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "current_position",        &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "evac_conveyor_stopped",   &tmp, simx_opmode_streaming) & 0xFE) == 0);
+	if(options_ & PackedProtocol) {
+		simxUChar* packed;
+		simxInt length;
+		all_ok &= ((simxGetStringSignal(client_id_, "sensors", &packed, &length, simx_opmode_streaming) & 0xFE) == 0);
+	}
+	else {
+		all_ok &= ((simxGetIntegerSignal(client_id_, "optical_barrier_state",   &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "gripper_closed",          &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "current_position",        &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "evac_conveyor_stopped",   &tmp, simx_opmode_streaming) & 0xFE) == 0);
+
+		all_ok &= ((simxGetIntegerSignal(client_id_, "end_identification",      &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "box_type",                &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "end_operation",           &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "assembly_ok",             &tmp, simx_opmode_streaming) & 0xFE) == 0);
+		all_ok &= ((simxGetIntegerSignal(client_id_, "assembly_evacuated",      &tmp, simx_opmode_streaming) & 0xFE) == 0);
+	}
+
+	return all_ok;
+}
+
+bool Simulator::wait_Ready(chrono::steady_clock::time_point start_time, int msec) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(msec);
+	auto elapsed = [start_time]() { return chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count(); };
+	bool handles_ok = false;
+
+	for(;;) {
+		if(not handles_ok) {
+			int ret_code = read_Handles();
+			if(ret_code == simx_return_ok) {
+				handles_ok = true;
+				startup_stats_.handles = elapsed();
+				simxGetObjectHandle(client_id_, "appro_proximity_sensor#", &appro_prox_sensor_handle_, simx_opmode_remove);
+			}
+			else if(ret_code != simx_return_novalue_flag) {
+				cout << "can't get appro_proximity_sensor handle (error " << ret_code << ")" << endl;
+				return false;
+			}
+		}
+
+		sensors_t sensors;
+		if(handles_ok and read_Sensors(sensors, simx_opmode_buffer)) {
+			startup_stats_.first_values = elapsed();
+			break;
+		}
+
+		auto now = chrono::steady_clock::now();
+		if(now >= deadline) {
+			cout << "Timeout while waiting for the first values from V-REP" << endl;
+			return false;
+		}
+
+		if(options_ & Synchronous) {
+			// Nothing new comes until the next simulation step
+			trigger_Step();
+		}
+		else {
+			wakeup_.wait_for(chrono::duration_cast<chrono::milliseconds>(deadline - now).count());
+		}
+	}
+
+	// The reply to simxStartSimulation is never read, don't let it stay in the input buffer
+	simxStartSimulation(client_id_, simx_opmode_remove);
+
+	return true;
+}
 
-	all_ok &= ((simxGetIntegerSignal(client_id_, "end_identification",      &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "box_type",                &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "end_operation",           &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "assembly_ok",             &tmp, simx_opmode_streaming) & 0xFE) == 0);
-	all_ok &= ((simxGetIntegerSignal(client_id_, "assembly_evacuated",      &tmp, simx_opmode_streaming) & 0xFE) == 0);
+bool Simulator::read_Sensors(sensors_t& sensors, int mode) {
+	bool all_ok = true;
+
+	if(options_ & PackedProtocol) {
+		simxUChar* packed;
+		simxInt length;
+		if(simxGetStringSignal(client_id_, "sensors", &packed, &length, mode) == simx_return_ok and length == sizeof(sensors_t))
+			memcpy(&sensors, packed, sizeof(sensors_t));
+		else
+			all_ok = false;
+	}
+	else {
+		all_ok &= simxGetIntegerSignal(client_id_, "optical_barrier_state",   &sensors.optical_barrier_state,     mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "gripper_closed",          &sensors.gripper_closed,            mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "current_position",        &sensors.current_position,          mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "evac_conveyor_stopped",   &sensors.evac_conveyor_stopped,     mode) == simx_return_ok;
+
+		all_ok &= simxGetIntegerSignal(client_id_, "end_identification",      &sensors.end_identification,        mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "box_type",                &sensors.box_type,                  mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "end_operation",           &sensors.end_operation,             mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "assembly_ok",             &sensors.assembly_ok,               mode) == simx_return_ok;
+		all_ok &= simxGetIntegerSignal(client_id_, "assembly_evacuated",      &sensors.assembly_evacuated,        mode) == simx_return_ok;
+	}
 
 	return all_ok;
 }
 
+void Simulator::message_Received(int /*client_id*/, void* simulator) {
+	static_cast<Simulator*>(simulator)->wakeup_.notify();
+}
+
+void Simulator::update_Command(Command command, bool state) {
+	unsigned int mask = 1u << command;
+	if(state)
+		change_Commands(mask, 0);
+	else
+		change_Commands(0, mask);
+}
+
+void Simulator::change_Commands(unsigned int set, unsigned int reset) {
+	unsigned int previous, next;
+
+	if(options_ & QueuedCommands) {
+		std::lock_guard<std::mutex> lock(command_queue_mutex_);
+		previous = commands_.load();
+		next = (previous & ~reset) | set;
+		if(next != previous) {
+			commands_.store(next);
+			command_change_t change = {next, chrono::steady_clock::now()};
+			// Never block the caller: if the communication thread is late by more than the queue size (or not running),
+			// keep the latest change aside. Only the pulse of the change it replaces is lost, not the level
+			if(has_overflow_change_ and command_queue_.try_send(overflow_change_))
+				has_overflow_change_ = false;
+			if(has_overflow_change_ or not command_queue_.try_send(change)) {
+				if(has_overflow_change_) {
+					std::lock_guard<std::mutex> lock(stats_mutex_);
+					++stats_.dropped_changes;
+				}
+				overflow_change_ = change;
+				has_overflow_change_ = true;
+			}
+		}
+	}
+	else {
+		previous = commands_.load();
+		do {
+			next = (previous & ~reset) | set;
+		} while(not commands_.compare_exchange_weak(previous, next));
+	}
+
+	if(previous != next and (options_ & ImmediateCommands))
+		wakeup_.notify();
+}
+
+void Simulator::apply(std::initializer_list<std::pair<Command, bool>> changes) {
+	unsigned int set = 0, reset = 0;
+	for(auto& change : changes) {
+		if(change.second)
+			set |= 1u << change.first;
+		else
+			reset |= 1u << change.first;
+	}
+
+	change_Commands(set, reset);
+}
+
+Simulator::TransmissionStats Simulator::get_Transmission_Stats() {
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	return stats_;
+}
+
+Simulator::StartupStats Simulator::get_Startup_Stats() {
+	return startup_stats_;
+}
+
+Simulator::ConnectionStats Simulator::get_Connection_Stats() {
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	return connection_stats_;
+}
+
+unsigned int Simulator::get_Commands() {
+	return commands_.load();
+}
+
+unsigned int Simulator::get_Queued_Commands() {
+	unsigned int changed = 0;
+	unsigned long taken = 0;
+	double max_latency = 0.;
+	auto now = chrono::steady_clock::now();
+
+	for(;;) {
+		if(not has_next_change_) {
+			if(not command_queue_.try_receive(next_change_)) {
+				// The change kept aside comes after the ones queued meanwhile, so look at the queue again under the lock
+				std::lock_guard<std::mutex> lock(command_queue_mutex_);
+				if(not command_queue_.try_receive(next_change_)) {
+					if(not has_overflow_change_)
+						break;
+					next_change_ = overflow_change_;
+					has_overflow_change_ = false;
+				}
+			}
+			has_next_change_ = true;
+		}
+
+		// A command changing twice must wait for the next cycle, otherwise V-REP would never see its intermediate level
+		unsigned int toggled = next_change_.commands ^ queued_commands_;
+		if(toggled & changed)
+			break;
+
+		changed |= toggled;
+		queued_commands_ = next_change_.commands;
+		has_next_change_ = false;
+
+		++taken;
+		max_latency = std::max(max_latency, chrono::duration<double, milli>(now - next_change_.time).count());
+	}
+
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	stats_.queued_changes += taken;
+	stats_.max_queue_latency = std::max(stats_.max_queue_latency, max_latency);
+
+	return queued_commands_;
+}
+
+void Simulator::flush_Queued_Commands() {
+	unsigned long dropped = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(command_queue_mutex_);
+		command_change_t change;
+		while(command_queue_.try_receive(change))
+			++dropped;
+		dropped += has_next_change_ + has_overflow_change_;
+		has_next_change_ = false;
+		has_overflow_change_ = false;
+		queued_commands_ = commands_.load();
+	}
+
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	stats_.dropped_changes += dropped;
+}
+
+void Simulator::send_Commands(unsigned int commands) {
+	unsigned long sent = 0, saved = 0, bytes_sent = 0, bytes_saved = 0;
+
+	// Send everything if delta mode is disabled or if it is time to refresh V-REP's state
+	bool send_all = not (options_ & DeltaCommands);
+	// The simulation time goes back to zero if V-REP restarted the simulation after a reconnection
+	if(get_Time() - last_commands_refresh_time_ >= COMMANDS_REFRESH_PERIOD or get_Time() < last_commands_refresh_time_) {
+		last_commands_refresh_time_ = get_Time();
+		send_all = true;
+	}
+
+	if(options_ & PackedProtocol) {
+		// All the commands are sent at once as a bitmask
+		unsigned long size = SIMX_SUBHEADER_SIZE + strlen("commands") + 1 + sizeof(simxInt);
+		if(send_all or commands != last_sent_commands_) {
+			simxSetIntegerSignal(client_id_, "commands", commands, simx_opmode_oneshot);
+			++sent;
+			bytes_sent += size;
+		}
+		else {
+			++saved;
+			bytes_saved += size;
+		}
+	}
+	else {
+		for (int i = 0; i < CommandCount; ++i) {
+			unsigned int mask = 1u << i;
+			// Size of the command in the outgoing message: header + signal name + value
+			unsigned long size = SIMX_SUBHEADER_SIZE + strlen(command_signal_names[i]) + 1 + sizeof(simxInt);
+
+			if(send_all or ((commands ^ last_sent_commands_) & mask)) {
+				simxSetIntegerSignal(client_id_, command_signal_names[i], (commands & mask) ? 1 : 0, simx_opmode_oneshot);
+				++sent;
+				bytes_sent += size;
+			}
+			else {
+				++saved;
+				bytes_saved += size;
+			}
+		}
+	}
+
+	last_sent_commands_ = commands;
+
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	++stats_.cycles;
+	stats_.commands_sent += sent;
+	stats_.commands_saved += saved;
+	stats_.bytes_sent += bytes_sent;
+	stats_.bytes_saved += bytes_saved;
+}
+
+void Simulator::update_Status(uint64_t previous, uint64_t status, StatusBit bit, Signal& rising, Signal& falling) {
+	uint64_t mask = uint64_t(1) << bit;
+	if((previous ^ status) & mask) {
+		if(status & mask)
+			rising.notify();
+		else
+			falling.notify();
+	}
+}
+
+bool Simulator::read_Status(StatusBit bit) {
+	return (status_.load() >> bit) & 1;
+}
+
+bool Simulator::wait_Status(StatusBit bit, bool state, Signal& edge, int msec) {
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(msec);
+
+	// The edge signal may have been notified long ago, so check the status each time it arrives
+	while(read_Status(bit) != state) {
+		if(msec < 0) {
+			edge.wait();
+		}
+		else {
+			auto now = chrono::steady_clock::now();
+			if(now >= deadline or not edge.wait_for(chrono::duration_cast<chrono::milliseconds>(deadline - now).count()))
+				return read_Status(bit) == state;
+		}
+	}
+
+	return true;
+}
+
 double Simulator::get_Current_Time() {
 	struct timeval tv;
 	gettimeofday(&tv,NULL);
 	return double(tv.tv_sec + tv.tv_usec*1e-6);
 }
 
-void Simulator::process(int cycle_ms) {
-	typedef chrono::duration<int, chrono::milliseconds::period> cycle;
+double Simulator::get_Time() {
+	if(options_ & Synchronous)
+		return simxGetLastCmdTime(client_id_) * 1e-3;
+	else
+		return get_Current_Time();
+}
+
+bool Simulator::check_Connection() {
+	int connection_id = simxGetConnectionId(client_id_);
+	if(connection_id == connection_id_)
+		return connection_id != -1;
+
+	auto now = chrono::steady_clock::now();
+
+	// The connection may have been lost and restored since the previous cycle
+	if(connection_id_ != -1) {
+		cout << "Connection to V-REP lost" << endl;
+		disconnection_time_ = now;
+		resyncing_ = false;
+		std::lock_guard<std::mutex> lock(stats_mutex_);
+		++connection_stats_.disconnections;
+	}
+
+	connection_id_ = connection_id;
+
+	if(connection_id != -1) {
+		cout << "Reconnected to V-REP" << endl;
+		reconnection_time_ = now;
+		resynchronize();
+	}
+
+	return connection_id != -1;
+}
 
-	simxInt optical_barrier_state, gripper_state, position, evac_conveyor_stopped;
-	simxInt end_identification, box_type, end_operation, assembly_ok, assembly_evacuated;
+void Simulator::resynchronize() {
+	simxPauseCommunication(client_id_, 1);
+
+	start_Streaming();
+	if(not (options_ & Synchronous))
+		simxStartSimulation(client_id_, simx_opmode_oneshot);
+
+	// Replay all the commands V-REP had before the connection loss
+	last_commands_refresh_time_ = -COMMANDS_REFRESH_PERIOD;
+	send_Commands((options_ & QueuedCommands) ? queued_commands_ : get_Commands());
+
+	// The simulation time may have started over, so restart the delay before the next object
+	supply_running_ = false;
+
+	simxPauseCommunication(client_id_, 0);
+
+	if(options_ & Synchronous) {
+		// V-REP leaves the synchronous mode when the client disconnects
+		simxSynchronous(client_id_, true);
+		simxStartSimulation(client_id_, simx_opmode_oneshot);
+	}
+
+	// Until the first values of the new connection arrive, the status is left untouched
+	resyncing_ = true;
+}
+
+void Simulator::trigger_Step() {
+	// Blocking calls made while disconnected would wait for their timeout
+	if(simxGetConnectionId(client_id_) == -1)
+		return;
+
+	simxInt ping_time;
+	simxSynchronousTrigger(client_id_);
+	simxGetPingTime(client_id_, &ping_time);
+}
 
-	simxGetIntegerSignal(client_id_, "optical_barrier_state",   &optical_barrier_state,     simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "gripper_closed",          &gripper_state,             simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "current_position",        &position,                  simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "evac_conveyor_stopped",   &evac_conveyor_stopped,     simx_opmode_oneshot_wait);
+void Simulator::wait_Cycle_End(chrono::steady_clock::time_point end_time) {
+	if(options_ & (EventDriven | ImmediateCommands)) {
+		// Wait for the next reply from V-REP or a command change, the cycle time acting as a timeout
+		auto now = chrono::steady_clock::now();
+		if(now < end_time)
+			wakeup_.wait_for(chrono::duration_cast<chrono::milliseconds>(end_time - now).count());
+	}
+	else {
+		this_thread::sleep_until(end_time);
+	}
+}
 
-	simxGetIntegerSignal(client_id_, "end_identification",      &end_identification,        simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "box_type",                &box_type,                  simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "end_operation",           &end_operation,             simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "assembly_ok",             &assembly_ok,               simx_opmode_oneshot_wait);
-	simxGetIntegerSignal(client_id_, "assembly_evacuated",      &assembly_evacuated,        simx_opmode_oneshot_wait);
+void Simulator::process(int cycle_ms) {
+	typedef chrono::duration<int, chrono::milliseconds::period> cycle;
 
-	cout << "Simulator communication thread started. Cycle time = " << cycle_ms << "ms" << endl;
+	sensors_t sensors;
+	memset(&sensors, 0, sizeof(sensors_t));
+
+	// start() has waited for the first values, they are already in the input buffer
+	read_Sensors(sensors, simx_opmode_buffer);
+
+	cout << "Simulator communication thread started. Cycle time = " << cycle_ms << "ms";
+	if(options_ & EventDriven)
+		cout << " (event driven)";
+	if(options_ & ImmediateCommands)
+		cout << " (immediate commands)";
+	if(options_ & DeltaCommands)
+		cout << " (delta commands)";
+	if(options_ & PackedProtocol)
+		cout << " (packed protocol)";
+	if(options_ & Synchronous)
+		cout << " (synchronous)";
+	if(options_ & QueuedCommands)
+		cout << " (queued commands)";
+	cout << endl;
+
+	uint32_t cycle_count = 0;
+
+	// In event driven mode, streaming is already running and we are woken up when new values are available, so just read the input buffer.
+	// In synchronous mode, the values of the last step are already in the input buffer when we read them
+	int read_mode = (options_ & (EventDriven | Synchronous)) ? simx_opmode_buffer : simx_opmode_streaming;
 
 	while(run_) {
 		auto start_time = chrono::steady_clock::now();
 		auto end_time = start_time + cycle(cycle_ms);
 
-		/***********************		Signals			************************/
-		simxGetIntegerSignal(client_id_, "optical_barrier_state",   &optical_barrier_state,     simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "gripper_closed",          &gripper_state,             simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "current_position",        &position,                  simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "evac_conveyor_stopped",   &evac_conveyor_stopped,     simx_opmode_streaming);
+		if(not check_Connection()) {
+			// V-REP gets the current commands once resynchronized, the changes made meanwhile can't be sent
+			if(options_ & QueuedCommands)
+				flush_Queued_Commands();
+			wait_Cycle_End(end_time);
+			continue;
+		}
 
-		simxGetIntegerSignal(client_id_, "end_identification",      &end_identification,        simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "box_type",                &box_type,                  simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "end_operation",           &end_operation,             simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "assembly_ok",             &assembly_ok,               simx_opmode_streaming);
-		simxGetIntegerSignal(client_id_, "assembly_evacuated",      &assembly_evacuated,        simx_opmode_streaming);
+		/***********************		Signals			************************/
+		bool all_read = read_Sensors(sensors, read_mode);
+
+		if(resyncing_) {
+			if(not all_read) {
+				// Some values of the new connection are still missing
+				if(options_ & QueuedCommands)
+					flush_Queued_Commands();
+				if(options_ & Synchronous)
+					trigger_Step();
+				wait_Cycle_End(end_time);
+				continue;
+			}
 
-		if(optical_barrier_state != prev_optical_barrier_state_) {
-			prev_optical_barrier_state_ = optical_barrier_state;
+			resyncing_ = false;
+			auto now = chrono::steady_clock::now();
+			double downtime = chrono::duration<double, milli>(now - disconnection_time_).count();
+			{
+				std::lock_guard<std::mutex> lock(stats_mutex_);
+				connection_stats_.last_downtime = downtime;
+				connection_stats_.max_downtime = std::max(connection_stats_.max_downtime, downtime);
+				connection_stats_.total_downtime += downtime;
+				connection_stats_.last_resync = chrono::duration<double, milli>(now - reconnection_time_).count();
+			}
+			cout << "Resynchronized with V-REP after " << downtime << "ms" << endl;
+		}
 
-			if(optical_barrier_state)
+		// Take a single snapshot of the commands for the whole cycle so that a transaction made with apply() is either entirely in it or not at all
+		unsigned int commands = (options_ & QueuedCommands) ? get_Queued_Commands() : get_Commands();
+
+		// Publish the new state before notifying anyone
+		uint64_t status = uint64_t(++cycle_count) << 32;
+		status |= uint64_t(sensors.optical_barrier_state != 0)				<< StatusCO;
+		status |= uint64_t(sensors.gripper_closed != 0)						<< StatusGripperClosed;
+		status |= uint64_t(sensors.current_position == PosAppro)			<< StatusPosT1;
+		status |= uint64_t(sensors.current_position == PosEvac)				<< StatusPosT2;
+		status |= uint64_t(sensors.current_position == PosAssembly)			<< StatusPosAssem;
+		status |= uint64_t(sensors.evac_conveyor_stopped != 0)				<< StatusArretT2;
+		status |= uint64_t(sensors.end_identification != 0)					<< StatusFinReccam;
+		status |= uint64_t(sensors.box_type == 1)							<< StatusP1;
+		status |= uint64_t(sensors.box_type == 2)							<< StatusP2;
+		status |= uint64_t(sensors.box_type == 3)							<< StatusP3;
+		status |= uint64_t(sensors.end_operation == 1)						<< StatusFinOP1;
+		status |= uint64_t(sensors.end_operation == 2)						<< StatusFinOP2;
+		status |= uint64_t(sensors.end_operation == 3)						<< StatusFinOP3;
+		status |= uint64_t(sensors.assembly_ok != 0)						<< StatusAssemblageConforme;
+		status |= uint64_t(sensors.assembly_evacuated != 0)					<< StatusAssemblageEvacue;
+		uint64_t previous_status = status_.exchange(status);
+
+		if(sensors.optical_barrier_state != prev_optical_barrier_state_) {
+			prev_optical_barrier_state_ = sensors.optical_barrier_state;
+
+			if(sensors.optical_barrier_state)
 				signals_.co.notify();
 		}
 
-		bool ongoing_operation = commands_.OP1 or commands_.OP2 or commands_.OP3;
-		if(not ongoing_operation and gripper_state != prev_gripper_state_) {
-			if(gripper_state) {
+		bool ongoing_operation = commands & ((1u << CmdOP1) | (1u << CmdOP2) | (1u << CmdOP3));
+		if(not ongoing_operation and sensors.gripper_closed != prev_gripper_state_) {
+			if(sensors.gripper_closed) {
 				std::cout << "NOTIFY: fprise\n";
 				signals_.fprise.notify();
 			}
@@ -205,10 +1068,10 @@ void Simulator::process(int cycle_ms) {
 				signals_.fpose.notify();
 			}
 		}
-		prev_gripper_state_ = gripper_state;
+		prev_gripper_state_ = sensors.gripper_closed;
 
-		if(position != prev_position_) {
-			switch(position) {
+		if(sensors.current_position != prev_position_) {
+			switch(sensors.current_position) {
 			case PosAssembly:
 				signals_.pos_assem.notify();
 				break;
@@ -219,139 +1082,119 @@ void Simulator::process(int cycle_ms) {
 				signals_.pos_t2.notify();
 				break;
 			}
-			prev_position_ = Position(position);
-			//cout << "position = " << position << endl;
+			prev_position_ = Position(sensors.current_position);
+			//cout << "position = " << sensors.current_position << endl;
 		}
 
-		if(evac_conveyor_stopped != prev_evac_conveyor_state_) {
-			prev_evac_conveyor_state_ = evac_conveyor_stopped;
+		if(sensors.evac_conveyor_stopped != prev_evac_conveyor_state_) {
+			prev_evac_conveyor_state_ = sensors.evac_conveyor_stopped;
 
-			if(evac_conveyor_stopped)
+			if(sensors.evac_conveyor_stopped)
 				signals_.arret_t2.notify();
 		}
 
-		signals_.fin_reccam = end_identification;
-		signals_.p1 = (box_type == 1);
-		signals_.p2 = (box_type == 2);
-		signals_.p3 = (box_type == 3);
-		signals_.fin_OP1 = (end_operation == 1);
-		signals_.fin_OP2 = (end_operation == 2);
-		signals_.fin_OP3 = (end_operation == 3);
-		signals_.assemblage_conforme = assembly_ok;
-		signals_.assemblage_evacue = assembly_evacuated;
+		update_Status(previous_status, status, StatusFinReccam,             signals_.fin_reccam_rising,             signals_.fin_reccam_falling);
+		update_Status(previous_status, status, StatusFinOP1,                signals_.fin_OP1_rising,                signals_.fin_OP1_falling);
+		update_Status(previous_status, status, StatusFinOP2,                signals_.fin_OP2_rising,                signals_.fin_OP2_falling);
+		update_Status(previous_status, status, StatusFinOP3,                signals_.fin_OP3_rising,                signals_.fin_OP3_falling);
+		update_Status(previous_status, status, StatusAssemblageConforme,    signals_.assemblage_conforme_rising,    signals_.assemblage_conforme_falling);
+		update_Status(previous_status, status, StatusAssemblageEvacue,      signals_.assemblage_evacue_rising,      signals_.assemblage_evacue_falling);
 
 		/***********************        Commands		***********************/
-		static bool test_t1 = true;
-		if(commands_.AV_T1) {
-			simxSetIntegerSignal(client_id_, "appro_conveyor_command", 1, simx_opmode_oneshot);
-			// Add new boxes to the conveyor
-			if(test_t1) {
-				last_created_object_time_ = get_Current_Time();
-				test_t1 = false;
-			}
-			if((get_Current_Time() - last_created_object_time_) > 1.) {
-				last_created_object_time_ = get_Current_Time();
+		// Hold the communication thread until all of this cycle's commands are queued so that they leave in the same message
+		simxPauseCommunication(client_id_, 1);
 
-#if LAZY_MODE
-				static int type = 0;
-				++type;
-				if(type > 3)
-					type = 1;
-#else
-				int object_to_add = rand() % 100;
-				int type;
-
-				if(last_created_object_type_ == 0) {
-					if(object_to_add < 33)
-						type = 1;
-					else if(object_to_add < 66)
-						type = 2;
-					else
-						type = 3;
-				}
-				else {
-					if(last_created_object_type_ == 1) {
-						if(object_to_add < 60)
-							type = 2;
-						else
-							type = 3;
-					}
-					else if(last_created_object_type_ == 2) {
-						if(object_to_add < 40)
-							type = 1;
-						else
-							type = 3;
-					}
-					else {
-						if(object_to_add < 60)
-							type = 1;
-						else
-							type = 2;
-					}
-				}
-
-				last_created_object_type_ = type;
-#endif
-
-				simxSetIntegerSignal(client_id_, "add_object", type, simx_opmode_oneshot);
-			}
+		if(commands & (1u << CmdAV_T1)) {
+			add_Objects();
 		}
 		else {
-			simxSetIntegerSignal(client_id_, "appro_conveyor_command", 0, simx_opmode_oneshot);
-			test_t1 = true;
+			supply_running_ = false;
 		}
 
-		if(commands_.AV_T2)
-			simxSetIntegerSignal(client_id_, "evac_conveyor_command", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "evac_conveyor_command", 0, simx_opmode_oneshot);
+		send_Commands(commands);
 
-		if(commands_.Reccam)
-			simxSetIntegerSignal(client_id_, "reccam", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "reccam", 0, simx_opmode_oneshot);
+		simxPauseCommunication(client_id_, 0);
 
-		if(commands_.D)
-			simxSetIntegerSignal(client_id_, "go_right", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "go_right", 0, simx_opmode_oneshot);
+		if(options_ & Synchronous) {
+			// Trigger the next simulation step (the commands are sent along with it) and wait for its completion
+			trigger_Step();
+		}
 
-		if(commands_.G)
-			simxSetIntegerSignal(client_id_, "go_left", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "go_left", 0, simx_opmode_oneshot);
+		wait_Cycle_End(end_time);
+	}
+}
 
-		if(commands_.Prend)
-			simxSetIntegerSignal(client_id_, "take", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "take", 0, simx_opmode_oneshot);
+void Simulator::add_Objects() {
+	if(not supply_running_) {
+		// Delays only run while the conveyor is moving
+		supply_running_ = true;
+		last_created_object_time_ = get_Time();
+	}
 
-		if(commands_.Pose)
-			simxSetIntegerSignal(client_id_, "put_down", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "put_down", 0, simx_opmode_oneshot);
+	std::shared_ptr<WorkloadGenerator> workload = std::atomic_load(&workload_);
+	if(workload != current_workload_) {
+		current_workload_ = workload;
+		has_next_object_ = false;
+	}
 
-		if(commands_.OP1)
-			simxSetIntegerSignal(client_id_, "OP1", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "OP1", 0, simx_opmode_oneshot);
+	if(not has_next_object_ and workload)
+		has_next_object_ = workload->next(next_object_);
 
-		if(commands_.OP2)
-			simxSetIntegerSignal(client_id_, "OP2", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "OP2", 0, simx_opmode_oneshot);
-
-		if(commands_.OP3)
-			simxSetIntegerSignal(client_id_, "OP3", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "OP3", 0, simx_opmode_oneshot);
+	// V-REP only sees the last value of the signal in a step, so add at most one object per cycle
+	if(has_next_object_ and get_Time() - last_created_object_time_ >= next_object_.delay) {
+		// Count the delay from the time the object should have been added so that the mean rate is kept
+		last_created_object_time_ += next_object_.delay;
+		simxSetIntegerSignal(client_id_, "add_object", next_object_.type, simx_opmode_oneshot);
+		has_next_object_ = false;
+	}
+}
 
-		if(commands_.Verif)
-			simxSetIntegerSignal(client_id_, "verif", 1, simx_opmode_oneshot);
-		else
-			simxSetIntegerSignal(client_id_, "verif", 0, simx_opmode_oneshot);
+void Simulator::set_Workload(std::shared_ptr<WorkloadGenerator> workload) {
+	std::atomic_store(&workload_, workload);
+}
 
-		this_thread::sleep_until(end_time);
+Signal& Simulator::get_Signal(Sensor sensor) {
+	switch(sensor) {
+	case SensorCO:
+		return signals_.co;
+	case SensorFprise:
+		return signals_.fprise;
+	case SensorFpose:
+		return signals_.fpose;
+	case SensorPosT1:
+		return signals_.pos_t1;
+	case SensorPosT2:
+		return signals_.pos_t2;
+	case SensorPosAssem:
+		return signals_.pos_assem;
+	case SensorArretT2:
+		return signals_.arret_t2;
+	case SensorFinReccam:
+		return signals_.fin_reccam_rising;
+	case SensorFinReccamFalling:
+		return signals_.fin_reccam_falling;
+	case SensorFinOP1:
+		return signals_.fin_OP1_rising;
+	case SensorFinOP1Falling:
+		return signals_.fin_OP1_falling;
+	case SensorFinOP2:
+		return signals_.fin_OP2_rising;
+	case SensorFinOP2Falling:
+		return signals_.fin_OP2_falling;
+	case SensorFinOP3:
+		return signals_.fin_OP3_rising;
+	case SensorFinOP3Falling:
+		return signals_.fin_OP3_falling;
+	case SensorAssemblageConforme:
+		return signals_.assemblage_conforme_rising;
+	case SensorAssemblageConformeFalling:
+		return signals_.assemblage_conforme_falling;
+	case SensorAssemblageEvacue:
+		return signals_.assemblage_evacue_rising;
+	case SensorAssemblageEvacueFalling:
+		return signals_.assemblage_evacue_falling;
+	default:
+		return signals_.arret_t2;
 	}
 }
 
@@ -418,86 +1261,158 @@ bool Simulator::wait_arret_t2(int msec) {
 		return signals_.arret_t2.wait_for(msec);
 }
 
+bool Simulator::wait_fin_reccam(int msec) {
+	return wait_Status(StatusFinReccam, true, signals_.fin_reccam_rising, msec);
+}
+
+bool Simulator::wait_fin_reccam_falling(int msec) {
+	return wait_Status(StatusFinReccam, false, signals_.fin_reccam_falling, msec);
+}
+
+bool Simulator::wait_fin_OP1(int msec) {
+	return wait_Status(StatusFinOP1, true, signals_.fin_OP1_rising, msec);
+}
+
+bool Simulator::wait_fin_OP1_falling(int msec) {
+	return wait_Status(StatusFinOP1, false, signals_.fin_OP1_falling, msec);
+}
+
+bool Simulator::wait_fin_OP2(int msec) {
+	return wait_Status(StatusFinOP2, true, signals_.fin_OP2_rising, msec);
+}
+
+bool Simulator::wait_fin_OP2_falling(int msec) {
+	return wait_Status(StatusFinOP2, false, signals_.fin_OP2_falling, msec);
+}
+
+bool Simulator::wait_fin_OP3(int msec) {
+	return wait_Status(StatusFinOP3, true, signals_.fin_OP3_rising, msec);
+}
+
+bool Simulator::wait_fin_OP3_falling(int msec) {
+	return wait_Status(StatusFinOP3, false, signals_.fin_OP3_falling, msec);
+}
+
+bool Simulator::wait_assemblage_conforme(int msec) {
+	return wait_Status(StatusAssemblageConforme, true, signals_.assemblage_conforme_rising, msec);
+}
+
+bool Simulator::wait_assemblage_conforme_falling(int msec) {
+	return wait_Status(StatusAssemblageConforme, false, signals_.assemblage_conforme_falling, msec);
+}
+
+bool Simulator::wait_assemblage_evacue(int msec) {
+	return wait_Status(StatusAssemblageEvacue, true, signals_.assemblage_evacue_rising, msec);
+}
+
+bool Simulator::wait_assemblage_evacue_falling(int msec) {
+	return wait_Status(StatusAssemblageEvacue, false, signals_.assemblage_evacue_falling, msec);
+}
+
+Simulator::SensorsState Simulator::read_all() {
+	uint64_t status = status_.load();
+	SensorsState state;
+
+	state.cycle                 = status >> 32;
+	state.co                    = (status >> StatusCO) & 1;
+	state.gripper_closed        = (status >> StatusGripperClosed) & 1;
+	state.pos_t1                = (status >> StatusPosT1) & 1;
+	state.pos_t2                = (status >> StatusPosT2) & 1;
+	state.pos_assem             = (status >> StatusPosAssem) & 1;
+	state.arret_t2              = (status >> StatusArretT2) & 1;
+	state.fin_reccam            = (status >> StatusFinReccam) & 1;
+	state.p1                    = (status >> StatusP1) & 1;
+	state.p2                    = (status >> StatusP2) & 1;
+	state.p3                    = (status >> StatusP3) & 1;
+	state.fin_OP1               = (status >> StatusFinOP1) & 1;
+	state.fin_OP2               = (status >> StatusFinOP2) & 1;
+	state.fin_OP3               = (status >> StatusFinOP3) & 1;
+	state.assemblage_conforme   = (status >> StatusAssemblageConforme) & 1;
+	state.assemblage_evacue     = (status >> StatusAssemblageEvacue) & 1;
+
+	return state;
+}
+
 bool Simulator::read_fin_reccam() {
-	return signals_.fin_reccam;
+	return read_Status(StatusFinReccam);
 }
 
 bool Simulator::read_p1() {
-	return signals_.p1;
+	return read_Status(StatusP1);
 }
 
 bool Simulator::read_p2() {
-	return signals_.p2;
+	return read_Status(StatusP2);
 }
 
 bool Simulator::read_p3() {
-	return signals_.p3;
+	return read_Status(StatusP3);
 }
 
 bool Simulator::read_fin_OP1() {
-	return signals_.fin_OP1;
+	return read_Status(StatusFinOP1);
 }
 
 bool Simulator::read_fin_OP2() {
-	return signals_.fin_OP2;
+	return read_Status(StatusFinOP2);
 }
 
 bool Simulator::read_fin_OP3() {
-	return signals_.fin_OP3;
+	return read_Status(StatusFinOP3);
 }
 
 bool Simulator::read_assemblage_conforme() {
-	return signals_.assemblage_conforme;
+	return read_Status(StatusAssemblageConforme);
 }
 
 bool Simulator::read_assemblage_evacue() {
-	return signals_.assemblage_evacue;
+	return read_Status(StatusAssemblageEvacue);
 }
 
 
 /***	Commands	***/
 void Simulator::set_AV_T1(bool state) {
-	commands_.AV_T1 = state;
+	update_Command(CmdAV_T1, state);
 }
 
 void Simulator::set_AV_T2(bool state) {
-	commands_.AV_T2 = state;
+	update_Command(CmdAV_T2, state);
 }
 
 void Simulator::set_Reccam(bool state) {
-	commands_.Reccam = state;
+	update_Command(CmdReccam, state);
 }
 
 void Simulator::set_D(bool state) {
-	commands_.D = state;
+	update_Command(CmdD, state);
 }
 
 void Simulator::set_G(bool state) {
-	commands_.G = state;
+	update_Command(CmdG, state);
 }
 
 void Simulator::set_Prend(bool state) {
-	commands_.Prend = state;
+	update_Command(CmdPrend, state);
 }
 
 void Simulator::set_Pose(bool state) {
-	commands_.Pose = state;
+	update_Command(CmdPose, state);
 }
 
 void Simulator::set_OP1(bool state) {
-	commands_.OP1 = state;
+	update_Command(CmdOP1, state);
 }
 
 void Simulator::set_OP2(bool state) {
-	commands_.OP2 = state;
+	update_Command(CmdOP2, state);
 }
 
 void Simulator::set_OP3(bool state) {
-	commands_.OP3 = state;
+	update_Command(CmdOP3, state);
 }
 
 void Simulator::set_Verif(bool state) {
-	commands_.Verif = state;
+	update_Command(CmdVerif, state);
 }
 
 Simulator sim;
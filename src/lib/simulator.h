@@ -1,6 +1,6 @@
 /**
  * @file simulator.h
- * @brief Implement a Simulator class to interact with V-REP as well as Signal and MessageBox classes
+ * @brief Implement a Simulator class to interact with V-REP as well as Signal, BroadcastSignal, MessageBox and MessageQueue classes
  * @author Benjamin Navarro
  * @version 1.0.0
  * @date 2015-10-12
@@ -14,9 +14,21 @@
 #include <chrono>
 #include <condition_variable>
 #include <atomic>
+#include <cstdint>
+#include <vector>
+#include <initializer_list>
+#include <utility>
+#include <memory>
+#include <string>
+
+#include "workload_generator.h"
+
+class BroadcastSignal;
 
 /**
- * @brief Implementation of a synchronization signal
+ * @brief Implementation of a synchronization signal.
+ * The signal state and the number of waiters are held in a single atomic word. A waiter first spins for a short
+ * (adaptive) amount of time and then sleeps on a futex (Linux) or a condition variable (other systems).
  */
 class Signal
 {
@@ -38,15 +50,192 @@ public:
 
 	bool wait_for(int ms);
 
+	/**
+	 * @brief Consume the signal if it has arrived (non-blocking call)
+	 * @return true if the signal was consumed, false otherwise
+	 */
+	bool try_wait();
+
+	/**
+	 * @brief Set the signal and wake up one waiter, which consumes it. The signal stays set until a waiter consumes it
+	 */
+	void notify();
+
+protected:
+	/**
+	 * @brief Spin for a short time, waiting for the signal
+	 * @return true if the signal was consumed, false otherwise
+	 */
+	bool spin();
+
+	/**
+	 * @brief Sleep until the state word changes or the timeout expires
+	 * @param state Expected value of the state word
+	 * @param ms Maximum time to sleep (milliseconds), infinite if negative
+	 */
+	void park(int state, int ms);
+
+	/**
+	 * @brief Wake up a sleeping waiter
+	 */
+	void unpark();
+
+	/**
+	 * @brief Bit 0: signaled, other bits: number of sleeping waiters
+	 */
+	std::atomic<int> state_;
+	/**
+	 * @brief Number of spin iterations before sleeping, adapted to how often spinning succeeds
+	 */
+	std::atomic<int> spin_count_;
+
+#ifndef __linux__
+	std::mutex m_;
+	std::condition_variable cv_;
+#endif
+
+private:
+	friend class WaitSet;
+
+	/**
+	 * @brief Notify a BroadcastSignal each time this signal is notified, until unwatch is called. Used by the waiting WaitSets
+	 * @param watcher The BroadcastSignal to notify
+	 */
+	void watch(BroadcastSignal& watcher);
+
+	/**
+	 * @brief Stop notifying a BroadcastSignal passed to watch
+	 * @param watcher The BroadcastSignal to stop notifying
+	 */
+	void unwatch(BroadcastSignal& watcher);
+
+	/**
+	 * @brief Number of watchers, checked without locking by notify
+	 */
+	std::atomic<int> watcher_count_;
+	std::mutex watchers_mutex_;
+	std::vector<BroadcastSignal*> watchers_;
+};
+
+/**
+ * @brief Implementation of a broadcast synchronization signal.
+ * Each notification increments a generation counter and wakes up all the threads waiting at that time, exactly once.
+ * The generation can also be used to check, without blocking, whether a notification happened since a given point.
+ */
+class BroadcastSignal
+{
+public:
+	BroadcastSignal();
+
+	~BroadcastSignal() = default;
+
+	/**
+	 * @brief Get the current generation, incremented by each notification
+	 * @return The current generation
+	 */
+	unsigned int generation() const;
+
+	/**
+	 * @brief Check if the signal has been notified since a given generation (non-blocking call)
+	 * @param generation A generation previously returned by generation()
+	 * @return true if at least one notification happened since then, false otherwise
+	 */
+	bool notified_since(unsigned int generation) const;
+
+	/**
+	 * @brief Wait for the next notification (blocking call)
+	 */
+	void wait();
+
+	/**
+	 * @brief Wait for the next notification (blocking call) for a certain amount of time
+	 * @param ms Number of milliseconds to wait before returning
+	 * @return true is the signal has arrived during the timeout period, false otherwise
+	 */
+	bool wait_for(int ms);
+
+	/**
+	 * @brief Wait for a notification happening after a given generation (blocking call). Returns immediately if one already happened
+	 * @param generation A generation previously returned by generation()
+	 */
+	void wait(unsigned int generation);
+
+	/**
+	 * @brief Wait for a notification happening after a given generation (blocking call) for a certain amount of time
+	 * @param ms Number of milliseconds to wait before returning
+	 * @param generation A generation previously returned by generation()
+	 * @return true is the signal has arrived since the given generation, false otherwise
+	 */
+	bool wait_for(int ms, unsigned int generation);
+
 	/**
 	 * @brief Notify all the waiters that the signal has arrived
 	 */
 	void notify();
 
 protected:
+	/**
+	 * @brief Sleep until the generation changes or the timeout expires
+	 * @param generation Expected value of the generation
+	 * @param ms Maximum time to sleep (milliseconds), infinite if negative
+	 */
+	void park(int generation, int ms);
+
+	/**
+	 * @brief Wake up all the sleeping waiters
+	 */
+	void unpark();
+
+	std::atomic<int> generation_;
+	std::atomic<int> waiters_;
+
+#ifndef __linux__
 	std::mutex m_;
 	std::condition_variable cv_;
-	std::atomic<bool> signaled_;
+#endif
+};
+
+/**
+ * @brief Wait for several signals at once.
+ * Signals are consumed the same way as with Signal::wait so a WaitSet can be mixed with direct waits on its signals.
+ * While waiting, the WaitSet is only woken up by its own signals.
+ */
+class WaitSet
+{
+public:
+	WaitSet();
+
+	/**
+	 * @param signals The signals to wait for
+	 */
+	WaitSet(std::initializer_list<Signal*> signals);
+
+	~WaitSet() = default;
+
+	/**
+	 * @brief Add a signal to the set
+	 * @param signal The signal to add
+	 * @return The index of the signal in the set
+	 */
+	int add(Signal& signal);
+
+	/**
+	 * @brief Wait for any of the signals to come (blocking call)
+	 * @param ms Number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return The index of the signal that has arrived, -1 if none arrived during the timeout period
+	 */
+	int wait_any(int ms = -1);
+
+	/**
+	 * @brief Wait for all the signals to come (blocking call)
+	 * @param ms Number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true if all the signals have arrived during the timeout period, false otherwise (the ones that have arrived are left signaled)
+	 */
+	bool wait_all(int ms = -1);
+
+private:
+	std::vector<Signal*> signals_;
+	size_t next_;
 };
 
 /**
@@ -67,9 +256,9 @@ public:
 	 * @param data The data to be sent
 	 */
 	void send(T data) {
-		m_.lock();
+		data_mutex_.lock();
 		data_ = data;
-		m_.unlock();
+		data_mutex_.unlock();
 		notify();
 	}
 
@@ -80,20 +269,193 @@ public:
 	 */
 	T receive() {
 		wait();
+		std::lock_guard<std::mutex> lock(data_mutex_);
 		return data_;
 	}
 
 private:
+	std::mutex data_mutex_;
 	T data_;
 };
 
+/**
+ * @brief What MessageQueue::send does when the queue is full
+ */
+enum OverflowPolicy {
+	BlockOnOverflow,	/**< Wait for a message to be received */
+	DropOldest,			/**< Remove the oldest message to make room for the new one */
+	DropNewest,			/**< Discard the new message */
+};
+
+/**
+ * @brief Implementation of a bounded lock-free message queue, usable with multiple producers and multiple consumers.
+ * Unlike MessageBox, messages are received in the order they have been sent and are not overwritten by newer ones.
+ *
+ * @tparam T Type of the data hold by the message queue
+ * @tparam Size Maximum number of messages in the queue, must be a power of two
+ */
+template<typename T, size_t Size = 16>
+class MessageQueue
+{
+	static_assert(Size >= 2 and (Size & (Size - 1)) == 0, "MessageQueue size must be a power of two");
+
+public:
+	/**
+	 * @param policy What to do when sending a message to a full queue
+	 */
+	MessageQueue(OverflowPolicy policy = BlockOnOverflow) :
+		policy_(policy),
+		send_pos_(0),
+		receive_pos_(0)
+	{
+		for (size_t i = 0; i < Size; ++i)
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	~MessageQueue() = default;
+
+	MessageQueue(const MessageQueue&) = delete;
+	MessageQueue& operator=(const MessageQueue&) = delete;
+
+	/**
+	 * @brief Send a new data. Blocks if the queue is full and the policy is BlockOnOverflow
+	 *
+	 * @param data The data to be sent
+	 * @return false if the data has been discarded (DropNewest policy), true otherwise
+	 */
+	bool send(T data) {
+		for(;;) {
+			// Take the generation before checking the queue, so that a message received meanwhile ends the wait
+			unsigned int generation = not_full_.generation();
+			if(try_send(data))
+				break;
+
+			switch(policy_) {
+			case BlockOnOverflow:
+				not_full_.wait(generation);
+				break;
+			case DropOldest:
+				{
+					T oldest;
+					try_receive(oldest);
+				}
+				break;
+			case DropNewest:
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Send a new data if the queue is not full (non-blocking call)
+	 *
+	 * @param data The data to be sent
+	 * @return true if the data has been queued, false if the queue is full
+	 */
+	bool try_send(const T& data) {
+		size_t pos = send_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for(;;) {
+			cell = &cells_[pos & (Size - 1)];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+			if(diff == 0) {
+				if(send_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+				return false;
+			else
+				pos = send_pos_.load(std::memory_order_relaxed);
+		}
+
+		cell->data = data;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		not_empty_.notify();
+		return true;
+	}
+
+	/**
+	 * @brief Receive the oldest data (blocking call)
+	 *
+	 * @return The received data
+	 */
+	T receive() {
+		T data;
+		for(;;) {
+			// Take the generation before checking the queue, so that a message sent meanwhile ends the wait
+			unsigned int generation = not_empty_.generation();
+			if(try_receive(data))
+				return data;
+			not_empty_.wait(generation);
+		}
+	}
+
+	/**
+	 * @brief Receive the oldest data if the queue is not empty (non-blocking call)
+	 *
+	 * @param data Where to store the received data
+	 * @return true if a data has been received, false if the queue is empty
+	 */
+	bool try_receive(T& data) {
+		size_t pos = receive_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for(;;) {
+			cell = &cells_[pos & (Size - 1)];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(sequence) - intptr_t(pos + 1);
+			if(diff == 0) {
+				if(receive_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+				return false;
+			else
+				pos = receive_pos_.load(std::memory_order_relaxed);
+		}
+
+		data = cell->data;
+		cell->sequence.store(pos + Size, std::memory_order_release);
+		not_full_.notify();
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	Cell cells_[Size];
+	OverflowPolicy policy_;
+
+	// Keep the producers and consumers positions on separate cache lines
+	char pad0_[64];
+	std::atomic<size_t> send_pos_;
+	char pad1_[64];
+	std::atomic<size_t> receive_pos_;
+	char pad2_[64];
+
+	/**
+	 * @brief Notified by each message sent and received. Every waiting consumer (resp. producer) wakes up and the ones losing the race wait again,
+	 * so no notification can be lost
+	 */
+	BroadcastSignal not_empty_;
+	BroadcastSignal not_full_;
+};
+
 /**
  * @brief Interface with the V-REP simulator
  */
 class Simulator
 {
 public:
-	Simulator();
+	/**
+	 * @param address IP address of the V-REP remote API server
+	 * @param port Port of the V-REP remote API server. Each simulator needs its own V-REP instance (address and port)
+	 */
+	Simulator(const std::string& address = "127.0.0.1", int port = 19997);
 	~Simulator();
 
 	Simulator(const Simulator& sim) {
@@ -103,21 +465,160 @@ public:
 		return *this;
 	}
 
+	/**
+	 * @brief Communication thread options, can be combined with a bitwise OR
+	 */
+	enum Option {
+		/**
+		 * @brief Wake up the communication thread as soon as a new reply from V-REP is received instead of sleeping a fixed cycle time.
+		 * The cycle time is then only used as a timeout.
+		 */
+		EventDriven = 1 << 0,
+		/**
+		 * @brief Wake up the communication thread as soon as a command changes so that it is sent to V-REP without waiting for the end of the cycle
+		 */
+		ImmediateCommands = 1 << 1,
+		/**
+		 * @brief Only send the commands that have changed since the last cycle.
+		 * All the commands are still sent periodically so that V-REP gets back in sync after a reconnection.
+		 */
+		DeltaCommands = 1 << 2,
+		/**
+		 * @brief Exchange all the commands as a single bitmask integer signal ("commands") and all the sensors as a single packed string signal ("sensors").
+		 * Requires the vrep/packed_protocol.lua script to be attached to the V-REP scene.
+		 */
+		PackedProtocol = 1 << 3,
+		/**
+		 * @brief Run V-REP in synchronous mode: the communication thread advances the simulation one step per cycle,
+		 * after having processed the signals and sent the commands of the previous step.
+		 * With a cycle time of zero, the simulation runs as fast as V-REP can step (real-time mode disabled).
+		 */
+		Synchronous = 1 << 4,
+		/**
+		 * @brief Queue every command change with its time stamp instead of sampling the commands once per cycle.
+		 * The changes are sent in order and each command level is held for at least one cycle, so a pulse shorter than a cycle is not lost.
+		 * Changes touching different commands are sent in the same cycle. Combine with Synchronous to hold each level for a simulation step.
+		 */
+		QueuedCommands = 1 << 5,
+	};
+
+	/**
+	 * @brief Commands transmission statistics, accumulated since the communication thread started.
+	 * Divide by cycles to get the per cycle values.
+	 */
+	struct TransmissionStats
+	{
+		unsigned long cycles;			/**< Number of communication cycles */
+		unsigned long commands_sent;	/**< Number of command signals sent to V-REP */
+		unsigned long commands_saved;	/**< Number of command signals not sent because unchanged */
+		unsigned long bytes_sent;		/**< Size of the sent command signals (bytes) */
+		unsigned long bytes_saved;		/**< Size of the command signals not sent (bytes) */
+		unsigned long queued_changes;	/**< Number of command changes taken from the queue (QueuedCommands mode) */
+		double max_queue_latency;		/**< Longest time between a command change and its transmission (QueuedCommands mode, milliseconds) */
+		unsigned long dropped_changes;	/**< Number of command changes never sent, a later level replacing them before they could be (QueuedCommands mode) */
+	};
+
+	/**
+	 * @brief Duration of the start() steps, in milliseconds since start() has been called
+	 */
+	struct StartupStats
+	{
+		double connection;		/**< Connection to V-REP established */
+		double handles;			/**< Object handles received */
+		double first_values;	/**< First streamed value of every sensor received */
+		double total;			/**< Communication thread launched */
+	};
+
+	/**
+	 * @brief Connection losses statistics, accumulated since the communication thread started.
+	 * The connection is automatically restored, the downtime lasts until the sensor values are streamed again
+	 */
+	struct ConnectionStats
+	{
+		unsigned long disconnections;	/**< Number of connection losses */
+		double last_downtime;			/**< Time between the last connection loss, as noticed by the communication thread, and the first new values (milliseconds) */
+		double max_downtime;			/**< Longest downtime (milliseconds) */
+		double total_downtime;			/**< Sum of all the downtimes (milliseconds) */
+		double last_resync;				/**< Time between the last reconnection and the first new values (milliseconds) */
+	};
+
 	/**
 	 * @brief Start the simulation in V-REP and the communication thread
 	 *
-	 * @param cycle_ms Communication thread cycle time (milliseconds)
+	 * @param cycle_ms Communication thread cycle time (milliseconds). Can be zero in Synchronous mode
+	 * @param options Communication thread options (see Option)
 	 *
 	 * @return True if successfully started, false otherwise
 	 */
-	bool start(int cycle_ms = 25);
+	bool start(int cycle_ms = 25, int options = 0);
 
 	/**
 	 * @brief Stop the simulation in V-REP and the communication thread
 	 */
 	void stop();
 
+	/**
+	 * @brief Get the commands transmission statistics
+	 *
+	 * @return A copy of the current statistics
+	 */
+	TransmissionStats get_Transmission_Stats();
+
+	/**
+	 * @brief Get the duration of the last start() steps
+	 *
+	 * @return A copy of the startup statistics
+	 */
+	StartupStats get_Startup_Stats();
+
+	/**
+	 * @brief Get the connection losses statistics
+	 *
+	 * @return A copy of the current statistics
+	 */
+	ConnectionStats get_Connection_Stats();
+
+	/**
+	 * @brief Change the generator deciding when and which objects are added to the supply conveyor.
+	 * The default one is a MarkovWorkload adding one object per second.
+	 *
+	 * @param workload The new generator, nullptr to stop adding objects
+	 */
+	void set_Workload(std::shared_ptr<WorkloadGenerator> workload);
+
 	/***	Signals		***/
+	/**
+	 * @brief Signals that can be waited for
+	 */
+	enum Sensor {
+		SensorCO,							/**< CO signal (optical barrier) */
+		SensorFprise,						/**< fprise signal (object took by the robot) */
+		SensorFpose,						/**< fpose signal (object put down by the robot) */
+		SensorPosT1,						/**< pos_t1 signal (robot over supply conveyor) */
+		SensorPosT2,						/**< pos_t2 signal (robot over evacuation conveyor) */
+		SensorPosAssem,						/**< pos_assem signal (robot over assembly station) */
+		SensorArretT2,						/**< arret_t2 signal (evacuation conveyor stopped) */
+		SensorFinReccam,					/**< fin_reccam signal rising edge (end of object recognition) */
+		SensorFinReccamFalling,				/**< fin_reccam signal falling edge */
+		SensorFinOP1,						/**< fin_OP1 signal rising edge (assembly operation 1 finished) */
+		SensorFinOP1Falling,				/**< fin_OP1 signal falling edge */
+		SensorFinOP2,						/**< fin_OP2 signal rising edge (assembly operation 2 finished) */
+		SensorFinOP2Falling,				/**< fin_OP2 signal falling edge */
+		SensorFinOP3,						/**< fin_OP3 signal rising edge (assembly operation 3 finished) */
+		SensorFinOP3Falling,				/**< fin_OP3 signal falling edge */
+		SensorAssemblageConforme,			/**< assemblage_conforme signal rising edge (good assembly) */
+		SensorAssemblageConformeFalling,	/**< assemblage_conforme signal falling edge */
+		SensorAssemblageEvacue,				/**< assemblage_evacue signal rising edge (evacuated assembly) */
+		SensorAssemblageEvacueFalling,		/**< assemblage_evacue signal falling edge */
+	};
+
+	/**
+	 * @brief Get the Signal associated with a sensor, e.g to wait for several of them using a WaitSet
+	 * @param sensor The sensor
+	 * @return The sensor's Signal
+	 */
+	Signal& get_Signal(Sensor sensor);
+
 	/**
 	 * @brief Wait for the CO signal (optical barrier)
 	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
@@ -160,6 +661,108 @@ public:
 	 * @return true is the signal has arrived during the timeout period, false otherwise
 	 */
 	bool wait_arret_t2(int msec = -1);
+	/**
+	 * @brief Wait for the fin_reccam signal (end of object recognition) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_fin_reccam(int msec = -1);
+	/**
+	 * @brief Wait for the fin_reccam signal (end of object recognition) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_fin_reccam_falling(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP1 signal (assembly operation 1 finished) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_fin_OP1(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP1 signal (assembly operation 1 finished) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_fin_OP1_falling(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP2 signal (assembly operation 2 finished) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_fin_OP2(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP2 signal (assembly operation 2 finished) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_fin_OP2_falling(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP3 signal (assembly operation 3 finished) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_fin_OP3(int msec = -1);
+	/**
+	 * @brief Wait for the fin_OP3 signal (assembly operation 3 finished) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_fin_OP3_falling(int msec = -1);
+	/**
+	 * @brief Wait for the assemblage_conforme signal (good assembly) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_assemblage_conforme(int msec = -1);
+	/**
+	 * @brief Wait for the assemblage_conforme signal (good assembly) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_assemblage_conforme_falling(int msec = -1);
+	/**
+	 * @brief Wait for the assemblage_evacue signal (evacuated assembly) to be set
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is set, false if the timeout period has expired
+	 */
+	bool wait_assemblage_evacue(int msec = -1);
+	/**
+	 * @brief Wait for the assemblage_evacue signal (evacuated assembly) to be reset
+	 * @param msec number of milliseconds to wait before returning. If negative (default value), the wait is infinite
+	 * @return true is the signal is reset, false if the timeout period has expired
+	 */
+	bool wait_assemblage_evacue_falling(int msec = -1);
+
+	/**
+	 * @brief State of all the sensors at the end of a communication cycle
+	 */
+	struct SensorsState
+	{
+		unsigned long cycle;		/**< Communication cycle number */
+		bool co;					/**< Optical barrier */
+		bool gripper_closed;		/**< Robot gripper closed */
+		bool pos_t1;				/**< Robot over supply conveyor */
+		bool pos_t2;				/**< Robot over evacuation conveyor */
+		bool pos_assem;				/**< Robot over assembly station */
+		bool arret_t2;				/**< Evacuation conveyor stopped */
+		bool fin_reccam;			/**< End of object recognition */
+		bool p1;					/**< Type 1 object */
+		bool p2;					/**< Type 2 object */
+		bool p3;					/**< Type 3 object */
+		bool fin_OP1;				/**< Assembly operation 1 finished */
+		bool fin_OP2;				/**< Assembly operation 2 finished */
+		bool fin_OP3;				/**< Assembly operation 3 finished */
+		bool assemblage_conforme;	/**< Good assembly */
+		bool assemblage_evacue;		/**< Evacuated assembly */
+	};
+
+	/**
+	 * @brief Read the state of all the sensors at once. All the values come from the same communication cycle
+	 *
+	 * @return State of the sensors
+	 */
+	SensorsState read_all();
 
 	/**
 	 * @brief Read the fin_reccam signal (end of object recognition)
@@ -216,6 +819,34 @@ public:
 	 */
 	bool read_assemblage_evacue();
 
+	/**
+	 * @brief Commands index, used as bit position in the commands bitmask
+	 */
+	enum Command {
+		CmdAV_T1 = 0,
+		CmdAV_T2,
+		CmdReccam,
+		CmdD,
+		CmdG,
+		CmdPrend,
+		CmdPose,
+		CmdOP1,
+		CmdOP2,
+		CmdOP3,
+		CmdVerif,
+		CommandCount
+	};
+
+	/**
+	 * @brief Change several commands at once. The communication thread sees either none or all of the changes
+	 * and sends them to V-REP in the same message.
+	 *
+	 * Example: sim.apply({{Simulator::CmdD, false}, {Simulator::CmdG, true}});
+	 *
+	 * @param changes The commands to change and their new state
+	 */
+	void apply(std::initializer_list<std::pair<Command, bool>> changes);
+
 	/***	Commands	***/
 	/**
 	 * @brief Set the AV_T1 command (supply conveyor)
@@ -286,23 +917,92 @@ public:
 
 protected:
 	/**
-	 * @brief Get object handles from V-REP
+	 * @brief Ask V-REP for the object handles without waiting for the reply. Use read_Handles() to get them
+	 */
+	void request_Handles();
+	/**
+	 * @brief Read the object handles requested with request_Handles()
 	 *
-	 * @return True if successful, false otherwise
+	 * @return simx_return_novalue_flag if the reply has not arrived yet, simx_return_ok if successful, another error code otherwise
 	 */
-	bool get_Handles();
+	int read_Handles();
 	/**
 	 * @brief Start data streaming from V-REP
 	 *
 	 * @return True if successful, false otherwise
 	 */
 	bool start_Streaming();
+	/**
+	 * @brief Wait for the object handles and the first streamed sensor values.
+	 * In Synchronous mode, simulation steps are triggered until they arrive
+	 *
+	 * @param start_time Time at which start() has been called, used to fill the startup statistics
+	 * @param msec Maximum waiting time (milliseconds)
+	 * @return True if everything has arrived, false otherwise
+	 */
+	bool wait_Ready(std::chrono::steady_clock::time_point start_time, int msec);
+	/**
+	 * @brief Stop the simulation and close the connection to V-REP, if open
+	 */
+	void close_Connection();
+	/**
+	 * @brief Detect the connection losses and the reconnections, and resynchronize V-REP after a reconnection
+	 *
+	 * @return True if connected to V-REP, false otherwise
+	 */
+	bool check_Connection();
+	/**
+	 * @brief Restore the state V-REP lost with the connection: streaming, simulation start and commands, sent in a single message
+	 */
+	void resynchronize();
+	/**
+	 * @brief Run a simulation step (Synchronous mode) and wait for its completion
+	 */
+	void trigger_Step();
+	/**
+	 * @brief Wait for the end of the communication cycle
+	 *
+	 * @param end_time End of the cycle
+	 */
+	void wait_Cycle_End(std::chrono::steady_clock::time_point end_time);
+	/**
+	 * @brief Sensor values read from V-REP.
+	 * The fields order matches the one of the packed "sensors" signal
+	 */
+	struct sensors_t
+	{
+		int32_t optical_barrier_state;
+		int32_t gripper_closed;
+		int32_t current_position;
+		int32_t evac_conveyor_stopped;
+		int32_t end_identification;
+		int32_t box_type;
+		int32_t end_operation;
+		int32_t assembly_ok;
+		int32_t assembly_evacuated;
+	};
+
+	/**
+	 * @brief Read all the sensor values from V-REP, either one signal at a time or in a single packed signal (PackedProtocol mode)
+	 *
+	 * @param sensors Where to store the sensor values. Left untouched if no packed value is available yet
+	 * @param mode V-REP operation mode
+	 * @return True if all the values have been read, false otherwise
+	 */
+	bool read_Sensors(sensors_t& sensors, int mode);
+
 	/**
 	 * @brief Get the current time since epoch
 	 *
 	 * @return Time in seconds (us precision)
 	 */
 	double get_Current_Time();
+	/**
+	 * @brief Get the time used to schedule periodic actions (new objects, commands refresh)
+	 *
+	 * @return Simulation time in Synchronous mode, current time otherwise (seconds)
+	 */
+	double get_Time();
 
 	/**
 	 * @brief Communication thread
@@ -311,25 +1011,144 @@ protected:
 	 */
 	void process(int cycle_ms);
 
+	/**
+	 * @brief Called by the V-REP communication thread when a new reply has been received
+	 *
+	 * @param client_id V-REP client ID
+	 * @param simulator The Simulator instance to wake up
+	 */
+	static void message_Received(int client_id, void* simulator);
+
+	/**
+	 * @brief Update a command and, in ImmediateCommands mode, wake up the communication thread if it has changed
+	 *
+	 * @param command The command to update
+	 * @param state The new state of the command
+	 */
+	void update_Command(Command command, bool state);
+
+	/**
+	 * @brief Set and reset several commands at once, queue the new commands in QueuedCommands mode
+	 * and, in ImmediateCommands mode, wake up the communication thread if they have changed
+	 *
+	 * @param set Mask of the commands to set
+	 * @param reset Mask of the commands to reset
+	 */
+	void change_Commands(unsigned int set, unsigned int reset);
+
+	/**
+	 * @brief Bits of the status word
+	 */
+	enum StatusBit {
+		StatusCO = 0,
+		StatusGripperClosed,
+		StatusPosT1,
+		StatusPosT2,
+		StatusPosAssem,
+		StatusArretT2,
+		StatusFinReccam,
+		StatusP1,
+		StatusP2,
+		StatusP3,
+		StatusFinOP1,
+		StatusFinOP2,
+		StatusFinOP3,
+		StatusAssemblageConforme,
+		StatusAssemblageEvacue,
+	};
 
 	/**
-	 * @brief Commands sent to V-REP
+	 * @brief Notify the rising or falling edge signal of a status bit if it has changed
+	 *
+	 * @param previous The previous status word
+	 * @param status The new status word
+	 * @param bit The status bit
+	 * @param rising Signal notified on a rising edge
+	 * @param falling Signal notified on a falling edge
+	 */
+	void update_Status(uint64_t previous, uint64_t status, StatusBit bit, Signal& rising, Signal& falling);
+
+	/**
+	 * @brief Wait for a status bit to reach a given state
+	 *
+	 * @param bit The status bit
+	 * @param state The expected state
+	 * @param edge Signal notified when the status bit changes to the expected state
+	 * @param msec number of milliseconds to wait before returning. If negative, the wait is infinite
+	 * @return true is the status bit has the expected state, false if the timeout period has expired
 	 */
-	struct commands_t
+	bool wait_Status(StatusBit bit, bool state, Signal& edge, int msec);
+
+	/**
+	 * @brief Read a status bit
+	 *
+	 * @param bit The status bit
+	 * @return The state of the bit
+	 */
+	bool read_Status(StatusBit bit);
+
+	/**
+	 * @brief Get the current state of all the commands
+	 *
+	 * @return A bitmask with bit i set if Command i is set
+	 */
+	unsigned int get_Commands();
+
+	/**
+	 * @brief Send the commands to V-REP (only the modified ones in DeltaCommands mode) and update the transmission statistics
+	 *
+	 * @param commands The commands to send, as returned by get_Commands()
+	 */
+	void send_Commands(unsigned int commands);
+
+	/**
+	 * @brief Take the next command changes from the queue (QueuedCommands mode).
+	 * Changes are taken in order until one of them modifies a command already modified during this cycle.
+	 *
+	 * @return The commands to send during this cycle
+	 */
+	unsigned int get_Queued_Commands();
+
+	/**
+	 * @brief Drop the command changes not sent yet, the next commands sent being the current ones (QueuedCommands mode).
+	 * Used when nothing is sent, so that the queue doesn't fill up
+	 */
+	void flush_Queued_Commands();
+
+
+	/**
+	 * @brief Commands sent to V-REP, bit i is set if Command i is set
+	 */
+	std::atomic<unsigned int> commands_;
+
+	/**
+	 * @brief A command change and the time it has been made at
+	 */
+	struct command_change_t
 	{
-		bool AV_T1;
-		bool AV_T2;
-		bool Reccam;
-		bool D;
-		bool G;
-		bool Prend;
-		bool Pose;
-		bool OP1;
-		bool OP2;
-		bool OP3;
-		bool Verif;
+		unsigned int commands;
+		std::chrono::steady_clock::time_point time;
 	};
-	commands_t commands_;
+
+	/**
+	 * @brief Command changes not sent yet (QueuedCommands mode)
+	 */
+	MessageQueue<command_change_t, 64> command_queue_;
+
+	/**
+	 * @brief Serializes the command changes so that they are queued in the order they are made
+	 */
+	std::mutex command_queue_mutex_;
+
+	/**
+	 * @brief Latest command change made while the queue was full, queued after the ones already there
+	 */
+	command_change_t overflow_change_;
+	bool has_overflow_change_;
+
+	command_change_t next_change_;
+	bool has_next_change_;
+	unsigned int queued_commands_;
 
 
 	/**
@@ -344,21 +1163,28 @@ protected:
 		Signal pos_t2;
 		Signal pos_assem;
 		Signal arret_t2;
+		Signal fin_reccam_rising;
+		Signal fin_reccam_falling;
+		Signal fin_OP1_rising;
+		Signal fin_OP1_falling;
+		Signal fin_OP2_rising;
+		Signal fin_OP2_falling;
+		Signal fin_OP3_rising;
+		Signal fin_OP3_falling;
+		Signal assemblage_conforme_rising;
+		Signal assemblage_conforme_falling;
+		Signal assemblage_evacue_rising;
+		Signal assemblage_evacue_falling;
 
-		bool fin_reccam;
-		bool p1;
-		bool p2;
-		bool p3;
-		bool scg;
-		bool scd;
-		bool fin_OP1;
-		bool fin_OP2;
-		bool fin_OP3;
-		bool assemblage_conforme;
-		bool assemblage_evacue;
 	};
 	signals_t signals_;
 
+	/**
+	 * @brief Sensor bits (StatusBit) in the lower 32 bits and cycle number in the upper 32 bits.
+	 * Written once per cycle by the communication thread so that readers always get a consistent state
+	 */
+	std::atomic<uint64_t> status_;
+
 	/**
 	 * @brief Current robot position
 	 */
@@ -373,13 +1199,45 @@ protected:
 	int prev_optical_barrier_state_;
 	int prev_evac_conveyor_state_;
 
+	/**
+	 * @brief Add the next object to the supply conveyor if it is time to. Called each cycle while the conveyor is running
+	 */
+	void add_Objects();
+
+	std::shared_ptr<WorkloadGenerator> workload_;
+	/**
+	 * @brief Generator next_object_ comes from, kept alive so that a new generator can't be allocated at its address and be mistaken for it
+	 */
+	std::shared_ptr<WorkloadGenerator> current_workload_;
+	WorkloadGenerator::Arrival next_object_;
+	bool has_next_object_;
+	bool supply_running_;
 	double last_created_object_time_;
-	int last_created_object_type_;
 
 	std::thread thread_;
 	bool run_;
+	int options_;
+
+	unsigned int last_sent_commands_;
+	double last_commands_refresh_time_;
+	TransmissionStats stats_;
+	std::mutex stats_mutex_;
+	StartupStats startup_stats_;
+	ConnectionStats connection_stats_;
+
+	int connection_id_;
+	bool resyncing_;
+	std::chrono::steady_clock::time_point disconnection_time_;
+	std::chrono::steady_clock::time_point reconnection_time_;
+
+	/**
+	 * @brief Wakes up the communication thread before the end of its cycle
+	 */
+	Signal wakeup_;
 
 	int client_id_;
+	std::string address_;
+	int port_;
 	int appro_prox_sensor_handle_;
 
 };
@@ -29,6 +29,7 @@
 #include "extApi.h"
 #include "extApiInternal.h"
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _Included_extApiJava
 	#include "extApiJava.h"
@@ -175,14 +176,30 @@ EXTAPI_DLLEXPORT simxInt simxStart(const simxChar* connectionAddress,simxInt con
 	_splitCommandsToSend_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
 	_splitCommandsToSend_dataSize[clientID]=0;
 
+	_messageSent[clientID]=extApi_allocateBuffer(SIMX_INIT_BUFF_SIZE);
+	_messageSent_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
+
 	_messageReceived[clientID]=extApi_allocateBuffer(SIMX_INIT_BUFF_SIZE);
 	_messageReceived_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
 	_messageReceived_dataSize[clientID]=0;
+	_messageReceived_deadDataSize[clientID]=0;
+	_messageReceived_index[clientID]=0;
+	_messageReceived_indexSize[clientID]=0;
+	_messageReceived_indexCount[clientID]=0;
 
 	_splitCommandsReceived[clientID]=extApi_allocateBuffer(SIMX_INIT_BUFF_SIZE);
 	_splitCommandsReceived_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
 	_splitCommandsReceived_dataSize[clientID]=0;
 
+	_replyReceived[clientID]=extApi_allocateBuffer(SIMX_INIT_BUFF_SIZE);
+	_replyReceived_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
+	_replyReceived_dataSize[clientID]=0;
+	_packetReceived_dataLeft[clientID]=-1;
+
+	_receiveRing[clientID]=extApi_allocateBuffer(SIMX_RECEIVE_RING_SIZE);
+	_receiveRing_start[clientID]=0;
+	_receiveRing_dataSize[clientID]=0;
+
 	_commandReceived[clientID]=extApi_allocateBuffer(SIMX_INIT_BUFF_SIZE);
 	_commandReceived_bufferSize[clientID]=SIMX_INIT_BUFF_SIZE;
 	_commandReceived_simulationTime[clientID]=0;
@@ -191,6 +208,8 @@ EXTAPI_DLLEXPORT simxInt simxStart(const simxChar* connectionAddress,simxInt con
 	_lastReceivedMessageID[clientID]=-1;
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* do not wait */
 	_minCommunicationDelay[clientID]=commThreadCycleInMs;
+	_inMessageCallback[clientID]=0;
+	_inMessageCallbackUserData[clientID]=0;
 
 	extApi_createMutexes(clientID);
 
@@ -201,12 +220,19 @@ EXTAPI_DLLEXPORT simxInt simxStart(const simxChar* connectionAddress,simxInt con
 	_tempConnectionPort[clientID]=connectionPort;
 	_tempDoNotReconnectOnceDisconnected[clientID]=doNotReconnectOnceDisconnected;
 
-	extApi_globalSimpleLock();
-	_clientIDForThread=clientID;
-	extApi_launchThread(_communicationThread);
-	while (_clientIDForThread!=-1)
-		extApi_switchThread(); /* wait until the thread is set */
-	extApi_globalSimpleUnlock();
+#ifdef EXTAPI_EPOLL
+	if (connectionPort>=0)
+		_ioRegister(clientID); /* sockets are serviced by a single thread */
+	else
+#endif
+	{
+		extApi_globalSimpleLock();
+		_clientIDForThread=clientID;
+		extApi_launchThread(_communicationThread);
+		while (_clientIDForThread!=-1)
+			extApi_switchThread(); /* wait until the thread is set */
+		extApi_globalSimpleUnlock();
+	}
 
 	if (waitUntilConnected==0)
 		return(clientID); /* we do not wait until connected */
@@ -250,6 +276,9 @@ EXTAPI_DLLEXPORT simxVoid simxFinish(simxInt clientID)
 
 			/* now tell the communication thread the end and wait until it's done: */
 			_communicationThreadRunning[clientID]=0;
+#ifdef EXTAPI_EPOLL
+			extApi_wakeUpPoller();
+#endif
 			while (_communicationThreadRunning[clientID]==0)
 				extApi_switchThread();
 			_communicationThreadRunning[clientID]=0;
@@ -258,9 +287,14 @@ EXTAPI_DLLEXPORT simxVoid simxFinish(simxInt clientID)
 			extApi_deleteMutexes(clientID);
 			extApi_releaseBuffer(_commandReceived[clientID]);
 			extApi_releaseBuffer(_splitCommandsReceived[clientID]);
+			extApi_releaseBuffer(_replyReceived[clientID]);
+			extApi_releaseBuffer(_receiveRing[clientID]);
 			extApi_releaseBuffer(_messageToSend[clientID]);
+			extApi_releaseBuffer(_messageSent[clientID]);
 			extApi_releaseBuffer(_splitCommandsToSend[clientID]);
 			extApi_releaseBuffer(_messageReceived[clientID]);
+			if (_messageReceived_index[clientID]!=0)
+				extApi_releaseBuffer((simxUChar*)_messageReceived_index[clientID]);
 			extApi_releaseBuffer((simxUChar*)_connectionIP[clientID]);
 			_nextConnectionID[clientID]=0; /* slot becomes free */
 
@@ -291,6 +325,9 @@ EXTAPI_DLLEXPORT simxVoid simxFinish(simxInt clientID)
 
 				/* now tell the communication thread to end and wait until it's done: */
 				_communicationThreadRunning[i]=0;
+#ifdef EXTAPI_EPOLL
+				extApi_wakeUpPoller();
+#endif
 				while (_communicationThreadRunning[i]==0)
 					extApi_switchThread();
 				_communicationThreadRunning[i]=0;
@@ -299,9 +336,14 @@ EXTAPI_DLLEXPORT simxVoid simxFinish(simxInt clientID)
 				extApi_deleteMutexes(i);
 				extApi_releaseBuffer(_commandReceived[i]);
 				extApi_releaseBuffer(_splitCommandsReceived[i]);
+				extApi_releaseBuffer(_replyReceived[i]);
+				extApi_releaseBuffer(_receiveRing[i]);
 				extApi_releaseBuffer(_messageToSend[i]);
+				extApi_releaseBuffer(_messageSent[i]);
 				extApi_releaseBuffer(_splitCommandsToSend[i]);
 				extApi_releaseBuffer(_messageReceived[i]);
+				if (_messageReceived_index[i]!=0)
+					extApi_releaseBuffer((simxUChar*)_messageReceived_index[i]);
 				extApi_releaseBuffer((simxUChar*)_connectionIP[i]);
 				_nextConnectionID[i]=0; /* slot becomes free */
 
@@ -316,9 +358,11 @@ simxVoid _waitUntilMessageArrived(simxInt clientID,simxInt* error)
 {
 	simxInt startTime;
 	simxInt lastReceivedMessageIDCopy;
+	simxInt connectionID;
 	if (_waitBeforeSendingAgainWhenMessageIDArrived[clientID]!=-1)
 	{ /* wait until we received a reply, or a timeout (if we wanna wait for the reply) */
 		startTime=extApi_getTimeInMs();
+		connectionID=_connectionID[clientID];
 		while (1)
 		{
 			extApi_lockResources(clientID);
@@ -326,6 +370,8 @@ simxVoid _waitUntilMessageArrived(simxInt clientID,simxInt* error)
 			extApi_unlockResources(clientID);
 			if ((extApi_getTimeDiffInMs(startTime)>=_replyWaitTimeoutInMs[clientID])||(lastReceivedMessageIDCopy>=_waitBeforeSendingAgainWhenMessageIDArrived[clientID]))
 				break;
+			if ( (connectionID!=-1)&&(_connectionID[clientID]!=connectionID) )
+				break; /* the connection was lost, the reply will never arrive */
 			extApi_switchThread();
 		}
 		if (lastReceivedMessageIDCopy<_waitBeforeSendingAgainWhenMessageIDArrived[clientID])
@@ -409,10 +455,14 @@ simxUChar* _exec_null(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUChar o
 
 	/* Check if the command is present in the input list */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_(cmdRaw,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_(clientID,cmdRaw);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_null(clientID,cmdRaw);
 	return(cmdPtr);
@@ -472,10 +522,14 @@ simxUChar* _exec_null_buffer(simxInt clientID,simxInt cmdRaw,simxInt opMode,simx
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_(cmdRaw,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_(clientID,cmdRaw);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_null(clientID,cmdRaw);
 	return(cmdPtr);
@@ -532,10 +586,14 @@ simxUChar* _exec_int(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUChar op
 
 	/* Check if the command is present in the input list */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_i(clientID,cmdRaw,intValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_int(clientID,cmdRaw,intValue);
 	return(cmdPtr);
@@ -590,10 +648,14 @@ simxUChar* _exec_intint(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUChar
 
 	/* Check if the command is present in the input list */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_ii(cmdRaw,intValue1,intValue2,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_ii(clientID,cmdRaw,intValue1,intValue2);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_intint(clientID,cmdRaw,intValue1,intValue2);
 	return(cmdPtr);
@@ -651,10 +713,14 @@ simxUChar* _exec_string(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUChar
 
 	/* Check if the command is present in the input list */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_s(cmdRaw,stringValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_s(clientID,cmdRaw,stringValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_string(clientID,cmdRaw,stringValue);
 	return(cmdPtr);
@@ -713,10 +779,14 @@ simxUChar* _exec_int_int(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUCha
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_i(clientID,cmdRaw,intValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_int(clientID,cmdRaw,intValue);
 	return(cmdPtr);
@@ -775,10 +845,14 @@ simxUChar* _exec_intint_int(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxU
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_ii(cmdRaw,intValue1,intValue2,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_ii(clientID,cmdRaw,intValue1,intValue2);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_intint(clientID,cmdRaw,intValue1,intValue2);
 	return(cmdPtr);
@@ -834,10 +908,14 @@ simxUChar* _exec_intint_buffer(simxInt clientID,simxInt cmdRaw,simxInt opMode,si
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_ii(cmdRaw,intValue1,intValue2,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_ii(clientID,cmdRaw,intValue1,intValue2);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_intint(clientID,cmdRaw,intValue1,intValue2);
 	return(cmdPtr);
@@ -896,10 +974,14 @@ simxUChar* _exec_int_float(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxUC
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_i(clientID,cmdRaw,intValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_int(clientID,cmdRaw,intValue);
 	return(cmdPtr);
@@ -958,10 +1040,14 @@ simxUChar* _exec_int_buffer(simxInt clientID,simxInt cmdRaw,simxInt opMode,simxU
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_i(clientID,cmdRaw,intValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_int(clientID,cmdRaw,intValue);
 	return(cmdPtr);
@@ -1020,10 +1106,14 @@ simxUChar* _exec_string_buffer(simxInt clientID,simxInt cmdRaw,simxInt opMode,si
 
 	/* Check if the command is present in the input list (we might have this situation when we want to check if there was an error on the server side) */
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_s(cmdRaw,stringValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_s(clientID,cmdRaw,stringValue);
 	cmdPtr=_setLastFetchedCmd(clientID,cmdPtr,error);
 	_waitBeforeSendingAgainWhenMessageIDArrived[clientID]=-1; /* make sure to enable the communication thread again! */
 	extApi_unlockResources(clientID);
+#ifdef EXTAPI_EPOLL
+	if (opMode==simx_opmode_oneshot_wait)
+		extApi_wakeUpPoller(); /* the I/O engine thread waits until the reply is read */
+#endif
 	if (opMode==simx_opmode_oneshot_wait) /* A cmd reply stays in the inbox always.. except when the mode is simx_opmode_oneshot_wait (to avoid polluting the inbox) */
 		_removeCommandReply_string(clientID,cmdRaw,stringValue);
 	return(cmdPtr);
@@ -1159,6 +1249,280 @@ simxUChar* _getCommandPointer_s(simxInt cmdRaw,const simxUChar* stringValue,cons
 	return(retVal);
 }
 
+simxInt _getCmdKeyType(simxInt cmdRaw)
+{
+	if ((cmdRaw>simx_cmd4bytes_start)&&(cmdRaw<simx_cmd8bytes_start))
+		return(SIMX_KEY_INT);
+	if ((cmdRaw>simx_cmd8bytes_start)&&(cmdRaw<simx_cmd1string_start))
+		return(SIMX_KEY_INTINT);
+	if ((cmdRaw>simx_cmd1string_start)&&(cmdRaw<simx_cmdreserved_start))
+		return(SIMX_KEY_STRING);
+	return(SIMX_KEY_NONE);
+}
+
+simxUInt _getCmdKeyHash(simxInt cmdRaw,simxInt keyType,const simxUChar* key)
+{ /* FNV-1a of the command id and of its key, as found in the buffers (i.e. already endian converted) */
+	simxUInt hash=2166136261u;
+	simxInt i,length;
+	for (i=0;i<4;i++)
+		hash=(hash^((cmdRaw>>(8*i))&0xff))*16777619u;
+	length=0;
+	if (keyType==SIMX_KEY_INT)
+		length=4;
+	if (keyType==SIMX_KEY_INTINT)
+		length=8;
+	if (keyType==SIMX_KEY_STRING)
+		length=extApi_getStringLength((const simxChar*)key);
+	for (i=0;i<length;i++)
+		hash=(hash^key[i])*16777619u;
+	return(hash);
+}
+
+simxUChar _isCmdKeySame(simxInt cmdRaw,simxInt keyType,const simxUChar* key,const simxUChar* cmdPtr)
+{ /* same comparison as _getCommandPointer_, _getCommandPointer_i, _getCommandPointer_ii or _getCommandPointer_s */
+	if ((extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask)!=cmdRaw)
+		return(0);
+	if (keyType==SIMX_KEY_INT)
+		return(memcmp(key,cmdPtr+SIMX_SUBHEADER_SIZE,4)==0);
+	if (keyType==SIMX_KEY_INTINT)
+		return(memcmp(key,cmdPtr+SIMX_SUBHEADER_SIZE,8)==0);
+	if (keyType==SIMX_KEY_STRING)
+		return(extApi_areStringsSame((const simxChar*)key,(const simxChar*)cmdPtr+SIMX_SUBHEADER_SIZE));
+	return(1);
+}
+
+simxVoid _indexReceivedCommands(simxInt clientID)
+{ /* the resources must be locked. Rebuilds the index of the input buffer (removed commands are left out) */
+	simxInt off,count,size,cmdRaw,keyType;
+	simxUInt slot,mask;
+	simxInt* index;
+	const simxUChar* buffer=_messageReceived[clientID];
+
+	count=0;
+	off=SIMX_HEADER_SIZE;
+	while (off<_messageReceived_dataSize[clientID])
+	{
+		count++;
+		off+=extApi_endianConversionInt(((simxInt*)(buffer+off+simx_cmdheaderoffset_mem_size))[0]);
+	}
+
+	/* keep the table at most a quarter full, so that as many commands can be inserted before it has to be rebuilt */
+	size=_messageReceived_indexSize[clientID];
+	if ( (size==0)||(size<4*count) )
+	{
+		if (size==0)
+			size=SIMX_MIN_INDEX_SIZE;
+		while (size<4*count)
+			size*=2;
+		if (_messageReceived_index[clientID]!=0)
+			extApi_releaseBuffer((simxUChar*)_messageReceived_index[clientID]);
+		_messageReceived_index[clientID]=(simxInt*)extApi_allocateBuffer(size*sizeof(simxInt));
+		_messageReceived_indexSize[clientID]=size;
+	}
+	index=_messageReceived_index[clientID];
+	memset(index,0,size*sizeof(simxInt));
+
+	/* Duplicates are all indexed, in buffer order along their probe sequence: lookups find them in the same order as a linear search */
+	mask=(simxUInt)size-1;
+	count=0;
+	off=SIMX_HEADER_SIZE;
+	while (off<_messageReceived_dataSize[clientID])
+	{
+		cmdRaw=extApi_endianConversionInt(((simxInt*)(buffer+off+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask;
+		if (cmdRaw!=0)
+		{
+			keyType=_getCmdKeyType(cmdRaw);
+			slot=_getCmdKeyHash(cmdRaw,keyType,buffer+off+SIMX_SUBHEADER_SIZE)&mask;
+			while (index[slot]!=0)
+				slot=(slot+1)&mask;
+			index[slot]=off;
+			count++;
+		}
+		off+=extApi_endianConversionInt(((simxInt*)(buffer+off+simx_cmdheaderoffset_mem_size))[0]);
+	}
+	_messageReceived_indexCount[clientID]=count;
+}
+
+simxVoid _indexReceivedCommand(simxInt clientID,simxInt off)
+{ /* the resources must be locked. Adds the command at offset off (the last one of the input buffer) to the index */
+	simxInt cmdRaw,keyType;
+	simxUInt slot,mask;
+	simxInt* index=_messageReceived_index[clientID];
+	const simxUChar* cmdPtr=_messageReceived[clientID]+off;
+
+	if ( (index==0)||(2*(_messageReceived_indexCount[clientID]+1)>_messageReceived_indexSize[clientID]) )
+	{ /* the table is half full (slots of removed commands are only freed by a rebuild) */
+		_indexReceivedCommands(clientID);
+		return;
+	}
+	mask=(simxUInt)_messageReceived_indexSize[clientID]-1;
+	cmdRaw=extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask;
+	keyType=_getCmdKeyType(cmdRaw);
+	slot=_getCmdKeyHash(cmdRaw,keyType,cmdPtr+SIMX_SUBHEADER_SIZE)&mask;
+	while (index[slot]!=0)
+		slot=(slot+1)&mask;
+	index[slot]=off;
+	_messageReceived_indexCount[clientID]++;
+}
+
+simxUChar* _getIndexedCommandPointer(simxInt clientID,simxInt cmdRaw,simxInt keyType,const simxUChar* key)
+{ /* the resources must be locked. The key is in the buffer format */
+	simxUInt slot,mask;
+	const simxInt* index=_messageReceived_index[clientID];
+	if ( (index==0)||(_messageReceived_dataSize[clientID]<=SIMX_HEADER_SIZE) )
+		return(0);
+	mask=(simxUInt)_messageReceived_indexSize[clientID]-1;
+	slot=_getCmdKeyHash(cmdRaw,keyType,key)&mask;
+	while (index[slot]!=0)
+	{
+		if (_isCmdKeySame(cmdRaw,keyType,key,_messageReceived[clientID]+index[slot]))
+			return(_messageReceived[clientID]+index[slot]);
+		slot=(slot+1)&mask;
+	}
+	return(0);
+}
+
+simxUChar* _getReceivedCommandPointer_(simxInt clientID,simxInt cmdRaw)
+{ /* the index only helps if the lookup uses the key of the command type */
+	if (_getCmdKeyType(cmdRaw)==SIMX_KEY_NONE)
+		return(_getIndexedCommandPointer(clientID,cmdRaw,SIMX_KEY_NONE,0));
+	return(_getCommandPointer_(cmdRaw,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE));
+}
+
+simxUChar* _getReceivedCommandPointer_i(simxInt clientID,simxInt cmdRaw,simxInt intValue)
+{
+	simxInt key;
+	if (_getCmdKeyType(cmdRaw)==SIMX_KEY_INT)
+	{
+		key=extApi_endianConversionInt(intValue);
+		return(_getIndexedCommandPointer(clientID,cmdRaw,SIMX_KEY_INT,(simxUChar*)&key));
+	}
+	return(_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE));
+}
+
+simxUChar* _getReceivedCommandPointer_ii(simxInt clientID,simxInt cmdRaw,simxInt intValue1,simxInt intValue2)
+{
+	simxInt key[2];
+	if (_getCmdKeyType(cmdRaw)==SIMX_KEY_INTINT)
+	{
+		key[0]=extApi_endianConversionInt(intValue1);
+		key[1]=extApi_endianConversionInt(intValue2);
+		return(_getIndexedCommandPointer(clientID,cmdRaw,SIMX_KEY_INTINT,(simxUChar*)key));
+	}
+	return(_getCommandPointer_ii(cmdRaw,intValue1,intValue2,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE));
+}
+
+simxUChar* _getReceivedCommandPointer_s(simxInt clientID,simxInt cmdRaw,const simxUChar* stringValue)
+{
+	if (_getCmdKeyType(cmdRaw)==SIMX_KEY_STRING)
+		return(_getIndexedCommandPointer(clientID,cmdRaw,SIMX_KEY_STRING,stringValue));
+	return(_getCommandPointer_s(cmdRaw,stringValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE));
+}
+
+simxUChar* _getSameReceivedCommandPointer(simxInt clientID,const simxUChar* cmdPtr)
+{ /* indexed version of _getSameCommandPointer for the input buffer */
+	simxInt cmdRaw=extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask;
+	simxInt keyType=_getCmdKeyType(cmdRaw);
+	if (keyType==SIMX_KEY_NONE)
+		return(0); /* such commands are never considered the same */
+	return(_getIndexedCommandPointer(clientID,cmdRaw,keyType,cmdPtr+SIMX_SUBHEADER_SIZE));
+}
+
+simxVoid _compactReceivedCommands(simxInt clientID)
+{ /* the resources must be locked. Once removed commands waste more than half of the input buffer, move the remaining ones together */
+	simxInt off,dest,memSize;
+	simxUChar* buffer=_messageReceived[clientID];
+
+	if ( (_messageReceived_deadDataSize[clientID]<=SIMX_MIN_BUFF_INCR)||(2*_messageReceived_deadDataSize[clientID]<=_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE) )
+		return;
+	off=SIMX_HEADER_SIZE;
+	dest=SIMX_HEADER_SIZE;
+	while (off<_messageReceived_dataSize[clientID])
+	{
+		memSize=extApi_endianConversionInt(((simxInt*)(buffer+off+simx_cmdheaderoffset_mem_size))[0]);
+		if (((simxInt*)(buffer+off+simx_cmdheaderoffset_cmd))[0]!=0)
+		{
+			if (dest!=off)
+				memmove(buffer+dest,buffer+off,memSize);
+			dest+=memSize;
+		}
+		off+=memSize;
+	}
+	_messageReceived_dataSize[clientID]=dest;
+	_messageReceived_deadDataSize[clientID]=0;
+	_indexReceivedCommands(clientID);
+}
+
+simxVoid _removeReceivedCommand(simxInt clientID,simxUChar* cmdPtr)
+{ /* the resources must be locked. The command only gets marked as removed: lookups skip it, and its space is reclaimed later */
+	((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0]=0;
+	_messageReceived_deadDataSize[clientID]+=extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_mem_size))[0]);
+	_compactReceivedCommands(clientID);
+}
+
+simxVoid _mergeReceivedCommand(simxInt clientID,const simxUChar* cmdPtr,simxInt cmdSize)
+{ /* the resources must be locked. Replaces the previous version of the command in the input buffer (in place if the size is the same), or adds it */
+	simxUChar* prevCmdPtr;
+	simxUChar* tempBuffer;
+	simxUChar* dest;
+	simxInt cmdRaw,keyType,prevOff,prevSize,cmdSizeWithoutPureData,previousPureDataSize,totalSize;
+
+	cmdRaw=extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask;
+	keyType=_getCmdKeyType(cmdRaw);
+	/* commands without key are replaced too: only their latest version could be read anyway */
+	prevCmdPtr=_getIndexedCommandPointer(clientID,cmdRaw,keyType,cmdPtr+SIMX_SUBHEADER_SIZE);
+	prevOff=0;
+	prevSize=0;
+	previousPureDataSize=0;
+	cmdSizeWithoutPureData=SIMX_SUBHEADER_SIZE+(simxInt)extApi_endianConversionUShort(((simxUShort*)(cmdPtr+simx_cmdheaderoffset_pdata_offset0))[0]);
+	if (prevCmdPtr!=0)
+	{
+		prevOff=(simxInt)(prevCmdPtr-_messageReceived[clientID]);
+		prevSize=extApi_endianConversionInt(((simxInt*)(prevCmdPtr+simx_cmdheaderoffset_mem_size))[0]);
+		if (cmdRaw==simx_cmd_read_string_stream)
+			previousPureDataSize=prevSize-cmdSizeWithoutPureData; /* special handling with this command: we merge it with the previous data */
+		if ( (previousPureDataSize==0)&&(prevSize==cmdSize) )
+		{ /* same size: overwrite the previous version */
+			memcpy(prevCmdPtr,cmdPtr,cmdSize);
+			return;
+		}
+	}
+
+	/* append the new version */
+	totalSize=cmdSize+previousPureDataSize;
+	if (_messageReceived_bufferSize[clientID]-_messageReceived_dataSize[clientID]<totalSize)
+	{ /* grow geometrically, so that appending stays cheap on average */
+		_messageReceived_bufferSize[clientID]*=2;
+		if (_messageReceived_bufferSize[clientID]<_messageReceived_dataSize[clientID]+totalSize)
+			_messageReceived_bufferSize[clientID]=_messageReceived_dataSize[clientID]+totalSize;
+		tempBuffer=extApi_allocateBuffer(_messageReceived_bufferSize[clientID]);
+		memcpy(tempBuffer,_messageReceived[clientID],_messageReceived_dataSize[clientID]);
+		extApi_releaseBuffer(_messageReceived[clientID]);
+		_messageReceived[clientID]=tempBuffer;
+	}
+	dest=_messageReceived[clientID]+_messageReceived_dataSize[clientID];
+	if (previousPureDataSize!=0)
+	{ /* new header part, previous data, then current data */
+		memcpy(dest,cmdPtr,cmdSizeWithoutPureData);
+		memcpy(dest+cmdSizeWithoutPureData,_messageReceived[clientID]+prevOff+cmdSizeWithoutPureData,previousPureDataSize);
+		memcpy(dest+cmdSizeWithoutPureData+previousPureDataSize,cmdPtr+cmdSizeWithoutPureData,cmdSize-cmdSizeWithoutPureData);
+		((simxInt*)(dest+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(totalSize);
+		((simxInt*)(dest+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(totalSize);
+	}
+	else
+		memcpy(dest,cmdPtr,cmdSize);
+	_messageReceived_dataSize[clientID]+=totalSize;
+
+	/* mark the previous version as removed before indexing the new one, then reclaim the space if needed */
+	if (prevCmdPtr!=0)
+	{
+		((simxInt*)(_messageReceived[clientID]+prevOff+simx_cmdheaderoffset_cmd))[0]=0;
+		_messageReceived_deadDataSize[clientID]+=prevSize;
+	}
+	_indexReceivedCommand(clientID,_messageReceived_dataSize[clientID]-totalSize);
+	_compactReceivedCommands(clientID);
+}
+
 simxVoid _removeChunkFromBuffer(const simxUChar* bufferStart,simxUChar* chunkStart,simxInt chunkSize,simxInt* buffer_dataSize)
 {
 	simxInt i,off,l;
@@ -1188,7 +1552,10 @@ simxUChar* _appendCommand_null_buff(simxInt cmd,simxUChar options,simxUChar* buf
 {
 	simxInt i;
 	simxUChar* retVal;
-	simxUChar* data=extApi_allocateBuffer(SIMX_SUBHEADER_SIZE+0+bufferSize);
+	simxUChar* data;
+	/* the command is written directly at the end of the destination buffer */
+	retVal=_appendChunkToBuffer(0,SIMX_SUBHEADER_SIZE+0+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
+	data=retVal+destBuffer_dataSize[0]-(SIMX_SUBHEADER_SIZE+0+bufferSize);
 	((simxInt*)(data+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+0+bufferSize);
 
 	((simxInt*)(data+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+0+bufferSize);
@@ -1200,8 +1567,6 @@ simxUChar* _appendCommand_null_buff(simxInt cmd,simxUChar options,simxUChar* buf
 	data[simx_cmdheaderoffset_status]=options;
 	for (i=0;i<bufferSize;i++)
 		data[SIMX_SUBHEADER_SIZE+0+i]=buffer[i];
-	retVal=_appendChunkToBuffer(data,SIMX_SUBHEADER_SIZE+0+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
-	extApi_releaseBuffer(data);
 	return(retVal);
 }
 
@@ -1243,7 +1608,10 @@ simxUChar* _appendCommand_s(simxInt cmd,simxUChar options,const simxUChar* strin
 	simxInt i;
 	simxUChar* retVal;
 	simxInt strLength=extApi_getStringLength((simxChar*)stringValue);
-	simxUChar* data=extApi_allocateBuffer(SIMX_SUBHEADER_SIZE+strLength+1);
+	simxUChar* data;
+	/* the command is written directly at the end of the destination buffer */
+	retVal=_appendChunkToBuffer(0,SIMX_SUBHEADER_SIZE+strLength+1,buffer,buffer_bufferSize,buffer_dataSize);
+	data=retVal+buffer_dataSize[0]-(SIMX_SUBHEADER_SIZE+strLength+1);
 	((simxInt*)(data+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+strLength+1);
 
 	((simxInt*)(data+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+strLength+1);
@@ -1256,8 +1624,6 @@ simxUChar* _appendCommand_s(simxInt cmd,simxUChar options,const simxUChar* strin
 	for (i=0;i<strLength;i++)
 		(data+SIMX_SUBHEADER_SIZE)[i]=stringValue[i];
 	(data+SIMX_SUBHEADER_SIZE)[strLength]=0; /* terminal 0 */
-	retVal=_appendChunkToBuffer(data,SIMX_SUBHEADER_SIZE+strLength+1,buffer,buffer_bufferSize,buffer_dataSize);
-	extApi_releaseBuffer(data);
 	return(retVal);
 }
 
@@ -1320,7 +1686,10 @@ simxUChar* _appendCommand_i_buff(simxInt cmd,simxUChar options,simxInt intValue,
 {
 	simxInt i;
 	simxUChar* retVal;
-	simxUChar* data=extApi_allocateBuffer(SIMX_SUBHEADER_SIZE+4+bufferSize);
+	simxUChar* data;
+	/* the command is written directly at the end of the destination buffer */
+	retVal=_appendChunkToBuffer(0,SIMX_SUBHEADER_SIZE+4+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
+	data=retVal+destBuffer_dataSize[0]-(SIMX_SUBHEADER_SIZE+4+bufferSize);
 	((simxInt*)(data+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+4+bufferSize);
 
 	((simxInt*)(data+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+4+bufferSize);
@@ -1333,8 +1702,6 @@ simxUChar* _appendCommand_i_buff(simxInt cmd,simxUChar options,simxInt intValue,
 	((simxInt*)(data+SIMX_SUBHEADER_SIZE))[0]=extApi_endianConversionInt(intValue);
 	for (i=0;i<bufferSize;i++)
 		data[SIMX_SUBHEADER_SIZE+4+i]=buffer[i];
-	retVal=_appendChunkToBuffer(data,SIMX_SUBHEADER_SIZE+4+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
-	extApi_releaseBuffer(data);
 	return(retVal);
 }
 
@@ -1342,7 +1709,10 @@ simxUChar* _appendCommand_ii_buff(simxInt cmd,simxUChar options,simxInt intValue
 {
 	simxInt i;
 	simxUChar* retVal;
-	simxUChar* data=extApi_allocateBuffer(SIMX_SUBHEADER_SIZE+4+4+bufferSize);
+	simxUChar* data;
+	/* the command is written directly at the end of the destination buffer */
+	retVal=_appendChunkToBuffer(0,SIMX_SUBHEADER_SIZE+4+4+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
+	data=retVal+destBuffer_dataSize[0]-(SIMX_SUBHEADER_SIZE+4+4+bufferSize);
 	((simxInt*)(data+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+4+4+bufferSize);
 
 	((simxInt*)(data+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+4+4+bufferSize);
@@ -1356,8 +1726,6 @@ simxUChar* _appendCommand_ii_buff(simxInt cmd,simxUChar options,simxInt intValue
 	((simxInt*)(data+SIMX_SUBHEADER_SIZE))[1]=extApi_endianConversionInt(intValue2);
 	for (i=0;i<bufferSize;i++)
 		data[SIMX_SUBHEADER_SIZE+4+4+i]=buffer[i];
-	retVal=_appendChunkToBuffer(data,SIMX_SUBHEADER_SIZE+4+4+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
-	extApi_releaseBuffer(data);
 	return(retVal);
 }
 
@@ -1365,7 +1733,10 @@ simxUChar* _appendCommand_s_buff(simxInt cmd,simxUChar options,const simxUChar*
 {
 	simxInt i;
 	simxUChar* retVal;
-	simxUChar* data=extApi_allocateBuffer(SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize);
+	simxUChar* data;
+	/* the command is written directly at the end of the destination buffer */
+	retVal=_appendChunkToBuffer(0,SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
+	data=retVal+destBuffer_dataSize[0]-(SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize);
 	((simxInt*)(data+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize);
 
 	((simxInt*)(data+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize);
@@ -1379,8 +1750,6 @@ simxUChar* _appendCommand_s_buff(simxInt cmd,simxUChar options,const simxUChar*
 		data[SIMX_SUBHEADER_SIZE+i]=stringValue[i];
 	for (i=0;i<bufferSize;i++)
 		data[SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+i]=buffer[i];
-	retVal=_appendChunkToBuffer(data,SIMX_SUBHEADER_SIZE+extApi_getStringLength((simxChar*)stringValue)+1+bufferSize,destBuffer,destBuffer_bufferSize,destBuffer_dataSize);
-	extApi_releaseBuffer(data);
 	return(retVal);
 }
 
@@ -1389,14 +1758,17 @@ simxUChar* _appendChunkToBuffer(const simxUChar* chunk,simxInt chunkSize,simxUCh
 	simxInt i,incr;
 	simxUChar* retBuffer;
 	if (buffer_bufferSize[0]-buffer_dataSize[0]<chunkSize)
-	{ /* not enough space in the buffer. Allocate more! */
+	{ /* not enough space in the buffer. Allocate more! (at least double the size, so that buffers quickly reach their steady state size) */
 		incr=chunkSize-(buffer_bufferSize[0]-buffer_dataSize[0]);
+		if (incr<buffer_bufferSize[0])
+			incr=buffer_bufferSize[0];
 		if (incr<SIMX_MIN_BUFF_INCR)
 			incr=SIMX_MIN_BUFF_INCR;
 		retBuffer=extApi_allocateBuffer(buffer_bufferSize[0]+incr);
 		for (i=0;i<buffer_dataSize[0];i++)
 			retBuffer[i]=buffer[i];
-		extApi_releaseBuffer(buffer);
+		if (buffer!=0)
+			extApi_releaseBuffer(buffer);
 		buffer_bufferSize[0]+=incr;
 	}
 	else
@@ -1411,50 +1783,6 @@ simxUChar* _appendChunkToBuffer(const simxUChar* chunk,simxInt chunkSize,simxUCh
 	return(retBuffer);
 }
 
-simxUChar* _appendCommandToBufferAndTakeIntoAccountPreviouslyReceivedData(const simxUChar* cmdPtr,simxUChar* cmdBuffer,simxInt cmdBufferSize,const simxUChar* chunk,simxInt chunkSize,simxUChar* buffer,simxInt* buffer_bufferSize,simxInt* buffer_dataSize)
-{
-	simxInt cmdRaw,cmdSizeWithoutPureData,previousPureDataSize,totalSize;
-	simxUChar* prevCmdPtr;
-	
-	cmdRaw=extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_cmd))[0])&simx_cmdmask;
-	if (cmdRaw==simx_cmd_read_string_stream)
-	{ /* special handling with this command: we merge it with the previous data of that type that was received: */
-		prevCmdPtr=_getSameCommandPointer(cmdPtr,cmdBuffer,cmdBufferSize);
-		if (prevCmdPtr!=0)
-		{ /* we have to merge the data: */
-			totalSize=0;
-
-			cmdSizeWithoutPureData=SIMX_SUBHEADER_SIZE+(simxInt)extApi_endianConversionUShort(((simxUShort*)(cmdPtr+simx_cmdheaderoffset_pdata_offset0))[0]);
-			previousPureDataSize=extApi_endianConversionInt(((simxInt*)(prevCmdPtr+simx_cmdheaderoffset_mem_size))[0])-cmdSizeWithoutPureData;
-
-			if (previousPureDataSize!=0)
-			{
-				/* 1. we append the new header part: */
-				buffer=_appendChunkToBuffer(chunk,cmdSizeWithoutPureData,buffer,buffer_bufferSize,buffer_dataSize);
-				totalSize=totalSize+cmdSizeWithoutPureData;
-
-				/* 2. we append the previous data: */
-				buffer=_appendChunkToBuffer(prevCmdPtr+cmdSizeWithoutPureData,previousPureDataSize,buffer,buffer_bufferSize,buffer_dataSize);
-				totalSize=totalSize+previousPureDataSize;
-
-				/* 3. we append the current data: */
-				buffer=_appendChunkToBuffer(chunk+cmdSizeWithoutPureData,chunkSize-cmdSizeWithoutPureData,buffer,buffer_bufferSize,buffer_dataSize);
-				totalSize=totalSize+(chunkSize-cmdSizeWithoutPureData);
-
-				/* 4. we correct some header values: */
-				((simxInt*)(buffer+buffer_dataSize[0]-totalSize+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(totalSize);
-				((simxInt*)(buffer+buffer_dataSize[0]-totalSize+simx_cmdheaderoffset_full_mem_size))[0]=extApi_endianConversionInt(totalSize);
-
-				/* the previous data will be discarded outside of this function */
-				return(buffer);
-			}
-		}
-		return(_appendChunkToBuffer(chunk,chunkSize,buffer,buffer_bufferSize,buffer_dataSize)); /* default behaviour is simply to append */
-	}
-	else
-		return(_appendChunkToBuffer(chunk,chunkSize,buffer,buffer_bufferSize,buffer_dataSize)); /* default behaviour is simply to append */
-}
-
 simxUChar* _getSameCommandPointer(const simxUChar* cmdPtr,simxUChar* cmdBuffer,simxInt cmdBufferSize)
 {
 	simxInt off,cmd1Raw,cmd2Raw;
@@ -1506,10 +1834,8 @@ simxInt _getCmdDataSize(simxUChar* commandPointer)
 
 simxUChar _sendMessage_socketOrSharedMem(simxInt clientID,const simxUChar* message,simxInt messageSize,simxUChar usingSharedMem)
 { /* return 1: success */
-	simxShort packetCount=0;
-	simxInt s=messageSize;
-	simxInt ptr=0;
-	simxInt sizeToSend;
+	simxInt packetCount,totalSize,sent;
+	simxInt off=0;
 
 	if (messageSize==0)
 		return(0);
@@ -1526,38 +1852,22 @@ simxUChar _sendMessage_socketOrSharedMem(simxInt clientID,const simxUChar* messa
 	else
 	{ /* send the message via sockets */
 		/* In Following we make sure we don't send too big packets (we might send the data in several packets) */
-		while (s!=0)
-		{
-			packetCount++;
-			if (s>SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH)
-				s-=SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH;
-			else
-				s=0;
-		}
-		s=messageSize;
-		while (s!=0)
+		packetCount=(messageSize+SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH-1)/(SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH);
+		totalSize=messageSize+packetCount*SOCKET_HEADER_LENGTH;
+		while (off<totalSize)
 		{
-			packetCount--;
-			sizeToSend=s;
-			if (s>SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH)
-				sizeToSend=SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH;
-			s-=sizeToSend;
-			if (_sendSimplePacket_socket(clientID,message+ptr,(simxShort)sizeToSend,packetCount)==0)
+			sent=_sendPackets_socket(clientID,message,messageSize,off);
+			if (sent<=0)
 				return(0);
-			ptr+=sizeToSend;
+			off+=sent;
 		}
 	}
 	return(1);
 }
 
 simxUChar* _receiveReplyMessage_socketOrSharedMem(simxInt clientID,simxInt* messageSize,simxUChar usingSharedMem)
-{ /* return 0: failure */
-	simxInt i,result;
-	simxInt cnt=0;
-	simxUChar* retBuff=0;
-	simxInt retBuffSize=0;
-	simxUChar* inDat;
-	simxShort inDatSize;
+{ /* return 0: failure. With sockets, the reply is in the reply buffer of the client, that stays valid until the next call. Otherwise, it has to be released */
+	simxInt startT,packetsLeft,waitingHeader;
 
 	if (usingSharedMem)
 	{ /* receive data via shared memory */
@@ -1569,114 +1879,350 @@ simxUChar* _receiveReplyMessage_socketOrSharedMem(simxInt clientID,simxInt* mess
 	}
 	else
 	{ /* receive data via sockets */
-		while (1)
-		{
-			result=_receiveSimplePacket_socket(clientID,&inDat,&inDatSize);
-			if (result<0)
-			{
-				if (cnt!=0)
-					extApi_releaseBuffer(retBuff);
-				return(0);
-			}
-			if (cnt==0)
-				retBuff=extApi_allocateBuffer((1+result)*(inDatSize+SOCKET_HEADER_LENGTH));
-			for (i=0;i<inDatSize;i++)
-				retBuff[retBuffSize+i]=inDat[i];
-			extApi_releaseBuffer(inDat);
-			retBuffSize+=inDatSize;
-			if (result==0)
-			{ /* ok, no more packets to receive */
-				messageSize[0]=retBuffSize;
-				return(retBuff);
+		_replyReceived_dataSize[clientID]=0;
+		startT=extApi_getTimeInMs();
+		packetsLeft=_packetReceived_packetsLeft[clientID];
+		waitingHeader=(_packetReceived_dataLeft[clientID]<0);
+		while (_takeReplyFromRing(clientID)==0)
+		{ /* the reply is not complete yet. Each packet gets SOCKET_TIMEOUT_READ ms for its header, then SOCKET_TIMEOUT_READ_DATA ms for its data */
+			if ((_packetReceived_packetsLeft[clientID]!=packetsLeft)||((_packetReceived_dataLeft[clientID]<0)!=waitingHeader))
+			{ /* a header was read or a packet completed since the last check */
+				startT=extApi_getTimeInMs();
+				packetsLeft=_packetReceived_packetsLeft[clientID];
+				waitingHeader=(_packetReceived_dataLeft[clientID]<0);
 			}
-			cnt+=1;
+			if (_receiveToRing_socket(clientID)<1)
+				return(0);
+			if (extApi_getTimeDiffInMs(startT)>(waitingHeader?SOCKET_TIMEOUT_READ:SOCKET_TIMEOUT_READ_DATA))
+				return(0);
 		}
+		messageSize[0]=_replyReceived_dataSize[clientID];
+		return(_replyReceived[clientID]);
 	}
 	return(0);
 }
 
-simxUChar _sendSimplePacket_socket(simxInt clientID,const simxUChar* packet,simxShort packetLength,simxShort packetsLeft)
-{
-	simxInt i;
-	simxUChar toSend[SOCKET_MAX_PACKET_SIZE];
+simxInt _sendPackets_socket(simxInt clientID,const simxUChar* message,simxInt messageSize,simxInt offset)
+{ /* Sends the message split into packets, starting at offset (counted in the packet stream, headers included).
+     The headers are sent from a separate buffer and the message data is not copied. Returns the number of bytes sent, or -1 */
+	simxUChar headers[SOCKET_MAX_GATHER_PACKETS][SOCKET_HEADER_LENGTH];
+	const simxUChar* chunks[2*SOCKET_MAX_GATHER_PACKETS];
+	simxInt chunkSizes[2*SOCKET_MAX_GATHER_PACKETS];
+	simxInt packetCount,packet,packetOffset,dataSize,chunkCount,i;
 
-	if (packetLength==0)
-		return(0);
+	packetCount=(messageSize+SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH-1)/(SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH);
+	packet=offset/SOCKET_MAX_PACKET_SIZE;
+	packetOffset=offset%SOCKET_MAX_PACKET_SIZE;
+	chunkCount=0;
+	for (i=0;(i<SOCKET_MAX_GATHER_PACKETS)&&(packet<packetCount);i++)
+	{
+		dataSize=messageSize-packet*(SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH);
+		if (dataSize>SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH)
+			dataSize=SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH;
+		if (packetOffset<SOCKET_HEADER_LENGTH)
+		{ /* Prepare the header */
+			((simxShort*)headers[i])[0]=extApi_endianConversionShort(1); /* Allows to detect Endianness on the other side */
+			((simxShort*)headers[i])[1]=extApi_endianConversionShort((simxShort)dataSize);
+			((simxShort*)headers[i])[2]=extApi_endianConversionShort((simxShort)(packetCount-1-packet));
+			chunks[chunkCount]=headers[i]+packetOffset;
+			chunkSizes[chunkCount++]=SOCKET_HEADER_LENGTH-packetOffset;
+			packetOffset=SOCKET_HEADER_LENGTH;
+		}
+		/* The rest of the packet is taken directly from the message */
+		chunks[chunkCount]=message+packet*(SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH)+packetOffset-SOCKET_HEADER_LENGTH;
+		chunkSizes[chunkCount++]=dataSize-(packetOffset-SOCKET_HEADER_LENGTH);
+		packetOffset=0;
+		packet++;
+	}
+	if (chunkCount==0)
+		return(-1);
+	return(extApi_sendGather_socket(clientID,chunks,chunkSizes,chunkCount));
+}
 
-	/* Prepare the header */
-	((simxShort*)toSend)[0]=extApi_endianConversionShort(1); /* Allows to detect Endianness on the other side */
-	((simxShort*)toSend)[1]=extApi_endianConversionShort(packetLength);
-	((simxShort*)toSend)[2]=extApi_endianConversionShort(packetsLeft);
-	
-	/* Prepare the rest of the packet */
-	for (i=0;i<packetLength;i++)
-		toSend[SOCKET_HEADER_LENGTH+i]=packet[i];
+simxInt _receiveToRing_socket(simxInt clientID)
+{ /* Reads as much data as available with a single system call: the rest of the current packet goes directly to the reply
+     (if nothing is waiting in the ring), and the data after it to the free space of the ring. Returns the number of bytes read, 0 if the connection was closed, -1 on error */
+	simxUChar* chunks[3];
+	simxInt chunkSizes[3];
+	simxInt chunkCount=0;
+	simxInt direct=0;
+	simxInt end,freeSize,n;
 
-	/* Send the packet */
-	if (extApi_send_socket(clientID,toSend,packetLength+SOCKET_HEADER_LENGTH)==packetLength+SOCKET_HEADER_LENGTH)
-		return(1);
-	return(0);
+	if ( (_receiveRing_dataSize[clientID]==0)&&(_packetReceived_dataLeft[clientID]>0) )
+	{
+		direct=_packetReceived_dataLeft[clientID];
+		chunks[chunkCount]=_replyReceived[clientID]+_replyReceived_dataSize[clientID];
+		chunkSizes[chunkCount++]=direct;
+	}
+	end=(_receiveRing_start[clientID]+_receiveRing_dataSize[clientID])&(SIMX_RECEIVE_RING_SIZE-1);
+	freeSize=SIMX_RECEIVE_RING_SIZE-_receiveRing_dataSize[clientID];
+	if (freeSize>0)
+	{ /* the free space might wrap around the end of the ring */
+		chunks[chunkCount]=_receiveRing[clientID]+end;
+		chunkSizes[chunkCount]=SIMX_RECEIVE_RING_SIZE-end;
+		if (chunkSizes[chunkCount]>freeSize)
+			chunkSizes[chunkCount]=freeSize;
+		freeSize-=chunkSizes[chunkCount++];
+		if (freeSize>0)
+		{
+			chunks[chunkCount]=_receiveRing[clientID];
+			chunkSizes[chunkCount++]=freeSize;
+		}
+	}
+
+	n=extApi_recvScatter_socket(clientID,chunks,chunkSizes,chunkCount);
+	if (n<=0)
+		return(n);
+	if (n<direct)
+		direct=n;
+	_replyReceived_dataSize[clientID]+=direct;
+	_packetReceived_dataLeft[clientID]-=direct;
+	_receiveRing_dataSize[clientID]+=n-direct;
+	return(n);
 }
 
-simxInt _receiveSimplePacket_socket(simxInt clientID,simxUChar** packet,simxShort* packetSize)
-{ /* Returns the number of packets left to read if >=0, otherwise error */
+simxInt _takeReplyFromRing(simxInt clientID)
+{ /* Parses the packets waiting in the ring, and appends their data to the reply. Returns 1 once the reply is complete, 0 otherwise */
+	simxUChar* ring=_receiveRing[clientID];
+	simxUChar header[SOCKET_HEADER_LENGTH];
+	simxInt i,n,part,dataSize;
 
-	/* 1. Read the header and packet size */
-	simxUChar headerAndSize[SOCKET_HEADER_LENGTH];
-	simxInt totalReceived=0;
-	simxInt nb;
-	simxShort dataLength,packetsLeft;
-	simxInt startT=extApi_getTimeInMs();
-	while(totalReceived!=SOCKET_HEADER_LENGTH)
+	while (1)
 	{
-		nb=extApi_recv_socket(clientID,headerAndSize+totalReceived,SOCKET_HEADER_LENGTH-totalReceived);
-		if (nb<1)
-			break;
-		totalReceived+=nb;
-		if (extApi_getTimeDiffInMs(startT)>SOCKET_TIMEOUT_READ)
-			break;
+		if (_packetReceived_dataLeft[clientID]<0)
+		{ /* 1. Read the header and packet size */
+			if (_receiveRing_dataSize[clientID]<SOCKET_HEADER_LENGTH)
+				return(0);
+			for (i=0;i<SOCKET_HEADER_LENGTH;i++)
+				header[i]=ring[(_receiveRing_start[clientID]+i)&(SIMX_RECEIVE_RING_SIZE-1)];
+			_receiveRing_start[clientID]=(_receiveRing_start[clientID]+SOCKET_HEADER_LENGTH)&(SIMX_RECEIVE_RING_SIZE-1);
+			_receiveRing_dataSize[clientID]-=SOCKET_HEADER_LENGTH;
+			_packetReceived_dataLeft[clientID]=extApi_endianConversionShort(((simxShort*)header)[1]);
+			_packetReceived_packetsLeft[clientID]=extApi_endianConversionShort(((simxShort*)header)[2]);
+			/* make room for the packet data in the reply */
+			dataSize=_replyReceived_dataSize[clientID];
+			_replyReceived[clientID]=_appendChunkToBuffer(0,_packetReceived_dataLeft[clientID],_replyReceived[clientID],&_replyReceived_bufferSize[clientID],&dataSize);
+		}
+
+		/* 2. Move the packet data that is already there to the reply (in up to two parts, if it wraps around the end of the ring) */
+		n=_packetReceived_dataLeft[clientID];
+		if (n>_receiveRing_dataSize[clientID])
+			n=_receiveRing_dataSize[clientID];
+		while (n>0)
+		{
+			part=SIMX_RECEIVE_RING_SIZE-_receiveRing_start[clientID];
+			if (part>n)
+				part=n;
+			memcpy(_replyReceived[clientID]+_replyReceived_dataSize[clientID],ring+_receiveRing_start[clientID],part);
+			_receiveRing_start[clientID]=(_receiveRing_start[clientID]+part)&(SIMX_RECEIVE_RING_SIZE-1);
+			_receiveRing_dataSize[clientID]-=part;
+			_replyReceived_dataSize[clientID]+=part;
+			_packetReceived_dataLeft[clientID]-=part;
+			n-=part;
+		}
+		if (_packetReceived_dataLeft[clientID]>0)
+			return(0);
+
+		/* 3. The packet is complete */
+		_packetReceived_dataLeft[clientID]=-1;
+		if (_packetReceived_packetsLeft[clientID]==0)
+			return(1);
 	}
-	
-	/* 2. Check if the header is consistent */
-	if (totalReceived!=SOCKET_HEADER_LENGTH)
-		return(-1);
-	dataLength=extApi_endianConversionShort(((simxShort*)headerAndSize)[1]);
-	packetsLeft=extApi_endianConversionShort(((simxShort*)headerAndSize)[2]);
-
-	/* 3. Read the data with correct length */
-	packetSize[0]=dataLength;
-	totalReceived=0;
-	startT=extApi_getTimeInMs();
-	packet[0]=extApi_allocateBuffer(dataLength);
-	while(totalReceived!=dataLength)
+}
+
+simxUChar* _buildRequestMessage(simxInt clientID,simxInt* messageSize)
+{ /* the resources must be locked. Moves the pending commands to the request buffer of the client, that stays valid until the next call */
+	simxUChar* tempBuffer;
+	simxInt tempBufferDataSize;
+	simxInt tempBufferBufferSize;
+	simxInt off,i,memSize;
+	simxUShort pureDataOffset0;
+	simxInt pureDataOffset1,maxPureDataSize,pureDataSize;
+	/* Take care of non-split commands first: the out buffer becomes the request, and the previous request buffer is reused as out buffer */
+	tempBuffer=_messageToSend[clientID];
+	tempBufferDataSize=_messageToSend_dataSize[clientID];
+	tempBufferBufferSize=_messageToSend_bufferSize[clientID];
+	_messageToSend[clientID]=_messageSent[clientID];
+	_messageToSend_bufferSize[clientID]=_messageSent_bufferSize[clientID];
+	for (i=0;i<SIMX_HEADER_SIZE;i++)
+		_messageToSend[clientID][i]=tempBuffer[i];
+	_messageToSend_dataSize[clientID]=SIMX_HEADER_SIZE; /* remove all non-split commands */
+	/* Take care of split commands here */
+	off=0;
+	while (off<_splitCommandsToSend_dataSize[clientID])
 	{
-		nb=extApi_recv_socket(clientID,packet[0]+totalReceived,dataLength-totalReceived);
-		if (nb<1)
-			break;
-		totalReceived+=nb;
-		if (extApi_getTimeDiffInMs(startT)>3000)
-			break;
+		memSize=extApi_endianConversionInt(((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_mem_size))[0]);
+		pureDataOffset0=extApi_endianConversionUShort(((simxUShort*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset0))[0]);
+		pureDataOffset1=extApi_endianConversionInt(((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset1))[0]);
+		maxPureDataSize=extApi_endianConversionUShort(((simxUShort*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_delay_or_split))[0]);
+		pureDataSize=memSize-SIMX_SUBHEADER_SIZE-pureDataOffset0-pureDataOffset1;
+		if (pureDataSize>maxPureDataSize)
+			pureDataSize=maxPureDataSize;
+		tempBuffer=_appendChunkToBuffer(_splitCommandsToSend[clientID]+off,SIMX_SUBHEADER_SIZE+pureDataOffset0,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
+		tempBuffer=_appendChunkToBuffer(_splitCommandsToSend[clientID]+off+SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1,pureDataSize,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
+		((simxInt*)(tempBuffer+tempBufferDataSize-pureDataSize-pureDataOffset0-SIMX_SUBHEADER_SIZE+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataSize);
+		if (SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+pureDataSize>=memSize)
+		{ /* command completely sent, we can remove it */
+			_removeChunkFromBuffer(_splitCommandsToSend[clientID],_splitCommandsToSend[clientID]+off,memSize,&_splitCommandsToSend_dataSize[clientID]);
+		}
+		else
+		{ /* command not yet completely sent. Keep it, but adjust the pure data offset1 */
+			pureDataOffset1+=pureDataSize;
+			((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset1))[0]=extApi_endianConversionInt(pureDataOffset1);
+			off+=memSize;
+		}
 	}
-	if (totalReceived!=dataLength)
+	/* Set some message header values */
+	tempBuffer[simx_headeroffset_version]=SIMX_VERSION;
+	((simxInt*)(tempBuffer+simx_headeroffset_message_id))[0]=extApi_endianConversionInt(_nextMessageIDToSend[clientID]++);
+	((simxInt*)(tempBuffer+simx_headeroffset_client_time))[0]=extApi_endianConversionInt(extApi_getTimeInMs());
+	/* CRC calculation represents a bottleneck for large transmissions, and is anyway not needed with tcp or shared memory transmissions */
+	/* ((simxUShort*)(tempBuffer+simx_headeroffset_crc))[0]=extApi_endianConversionUShort(_getCRC(tempBuffer+2,tempBufferDataSize-2)); */
+	((simxUShort*)(tempBuffer+simx_headeroffset_crc))[0]=extApi_endianConversionUShort(0);
+	_messageSent[clientID]=tempBuffer;
+	_messageSent_bufferSize[clientID]=tempBufferBufferSize;
+	messageSize[0]=tempBufferDataSize;
+	return(tempBuffer);
+}
+
+simxVoid _processReplyMessage(simxInt clientID,simxUChar* replyData,simxInt replyDataSize)
+{ /* merges a reply into the input buffer. The reply stays owned by the caller */
+	simxUChar* cmdPointer;
+	simxInt tmp,off,cmd,i,memSize,fullMemSize,memSize2;
+	simxUShort crc,pureDataOffset0;
+	simxInt pureDataOffset1,pureDataSize;
+	simxVoid (*inMessageCallback)(simxInt,simxVoid*);
+	simxVoid* inMessageCallbackUserData;
+
+	/* Check the CRC */
+	/* CRC calculation represents a bottleneck for large transmissions, and is anyway not needed with tcp or shared memory transmissions */
+	crc=extApi_endianConversionUShort(((simxUShort*)(replyData+simx_headeroffset_crc))[0]);
+	/* if (_getCRC(replyData+2,replyDataSize-2)==crc) */
+	if (1)
 	{
-		extApi_releaseBuffer(packet[0]);
-		return(-1);
+		/* Place the reply into the input buffer */
+		tmp=extApi_endianConversionInt(((simxInt*)(replyData+simx_headeroffset_message_id))[0]);
+
+		if (replyDataSize>SIMX_HEADER_SIZE)
+		{ /* We received a non-empty message */
+			extApi_lockResources(clientID);
+			/* a) Take the header from the received data, or keep the existing one (if id is -1) */
+			if (_messageReceived_dataSize[clientID]<SIMX_HEADER_SIZE)
+				_messageReceived_dataSize[clientID]=SIMX_HEADER_SIZE;
+			if (tmp!=-1)
+			{
+				for (i=0;i<SIMX_HEADER_SIZE;i++)
+					_messageReceived[clientID][i]=replyData[i];
+			}
+
+			/* b) go through the received data and merge it into the input buffer (or into the partial command buffer) */
+			off=SIMX_HEADER_SIZE;
+			while (off<replyDataSize)
+			{
+				memSize=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]);
+				fullMemSize=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_full_mem_size))[0]);
+				if (memSize==fullMemSize)
+				{ /* the full data was sent at once! */
+					cmd=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_cmd))[0]);
+					if ((cmd-(cmd&simx_cmdmask))!=simx_opmode_discontinue)
+						_mergeReceivedCommand(clientID,replyData+off,memSize);
+					else
+					{ /* discontinue mode commands are not added, they only remove their previous version */
+						cmdPointer=_getSameReceivedCommandPointer(clientID,replyData+off);
+						if (cmdPointer!=0)
+							_removeReceivedCommand(clientID,cmdPointer);
+					}
+				}
+				else
+				{ /* only partial data was sent */
+					
+					/* Try to merge the partial data with same data already present in the partial commands buffer */
+					cmdPointer=_getSameCommandPointer(replyData+off,_splitCommandsReceived[clientID],_splitCommandsReceived_dataSize[clientID]);
+					if (cmdPointer!=0)
+					{ /* there is previous partial data. Is it valid? */
+						memSize2=extApi_endianConversionInt(((simxInt*)(cmdPointer+simx_cmdheaderoffset_mem_size))[0]);						
+						if (memSize2!=fullMemSize)
+						{ /* we cannot use the previous version, since it has a different size. Remove it */
+							_removeChunkFromBuffer(_splitCommandsReceived[clientID],cmdPointer,memSize2,&_splitCommandsReceived_dataSize[clientID]);
+							cmdPointer=0;
+						}
+					}
+					if (cmdPointer==0)
+					{ /* there is not yet similar data present. Just add empty space */
+						_splitCommandsReceived[clientID]=_appendChunkToBuffer(0,fullMemSize,_splitCommandsReceived[clientID],&_splitCommandsReceived_bufferSize[clientID],&_splitCommandsReceived_dataSize[clientID]);
+						cmdPointer=_splitCommandsReceived[clientID]+_splitCommandsReceived_dataSize[clientID]-fullMemSize;
+					}
+					/* Now we have to overwrite the subheader, the command data, and the partial data */
+					for (i=0;i<SIMX_SUBHEADER_SIZE;i++)
+						cmdPointer[i]=replyData[off+i];
+					((simxInt*)(cmdPointer+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(fullMemSize); /* Important!! */
+
+					pureDataOffset0=extApi_endianConversionUShort(((simxUShort*)(cmdPointer+simx_cmdheaderoffset_pdata_offset0))[0]);
+					for (i=0;i<pureDataOffset0;i++)
+						cmdPointer[SIMX_SUBHEADER_SIZE+i]=replyData[off+SIMX_SUBHEADER_SIZE+i];
+
+					pureDataOffset1=extApi_endianConversionInt(((simxInt*)(cmdPointer+simx_cmdheaderoffset_pdata_offset1))[0]);
+					pureDataSize=memSize-SIMX_SUBHEADER_SIZE-pureDataOffset0;
+					for (i=0;i<pureDataSize;i++)
+						cmdPointer[SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+i]=replyData[off+SIMX_SUBHEADER_SIZE+pureDataOffset0+i];
+
+					/* Is the partial data complete yet? */
+					if (SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+pureDataSize>=fullMemSize)
+					{ /* yes!! Merge the data from the partial command buffer into the input buffer, and erase it from the partial command buffer */
+						_mergeReceivedCommand(clientID,cmdPointer,fullMemSize);
+						_removeChunkFromBuffer(_splitCommandsReceived[clientID],cmdPointer,fullMemSize,&_splitCommandsReceived_dataSize[clientID]);
+					}
+				}
+				off+=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]);
+			}
+			if (tmp!=-1)
+				_lastReceivedMessageID[clientID]=tmp;
+			inMessageCallback=_inMessageCallback[clientID];
+			inMessageCallbackUserData=_inMessageCallbackUserData[clientID];
+			extApi_unlockResources(clientID);
+			/* Tell the user new data is available (called without holding any lock, so that the callback can read the input buffer) */
+			if (inMessageCallback!=0)
+				inMessageCallback(clientID,inMessageCallbackUserData);
+		}
 	}
-	return(packetsLeft);
+}
+
+simxUChar _mustWaitForInputBufferRead(simxInt clientID)
+{ /* return 1: the reply to a blocking command is not read yet, don't send a new request */
+	simxInt waitBeforeSendingAgainWhenMessageIDArrived_copy;
+	extApi_lockResources(clientID);
+	waitBeforeSendingAgainWhenMessageIDArrived_copy=_waitBeforeSendingAgainWhenMessageIDArrived[clientID];
+	extApi_unlockResources(clientID);
+	if ((waitBeforeSendingAgainWhenMessageIDArrived_copy!=-1)&&(_messageReceived_dataSize[clientID]>=SIMX_HEADER_SIZE))
+		return(_lastReceivedMessageID[clientID]>=waitBeforeSendingAgainWhenMessageIDArrived_copy);
+	return(0);
+}
+
+simxVoid _clearConnectionBuffers(simxInt clientID)
+{ /* called once disconnected */
+	extApi_lockResources(clientID);
+	_messageToSend_dataSize[clientID]=SIMX_HEADER_SIZE;
+	_splitCommandsToSend_dataSize[clientID]=0;
+	_messageReceived_dataSize[clientID]=0;
+	_messageReceived_deadDataSize[clientID]=0;
+	_indexReceivedCommands(clientID);
+	_splitCommandsReceived_dataSize[clientID]=0;
+	extApi_unlockResources(clientID);
+	/* data of the old connection that was not parsed yet */
+	_receiveRing_start[clientID]=0;
+	_receiveRing_dataSize[clientID]=0;
+	_packetReceived_dataLeft[clientID]=-1;
+	/* printf("Disconnected\n"); */
+	_connectionID[clientID]=-1;
 }
 
 SIMX_THREAD_RET_TYPE _communicationThread(simxVoid* p)
 {
 	simxUChar* replyData;
 	simxUChar* tempBuffer;
-	simxUChar* cmdPointer;
 	simxInt tempBufferDataSize;
-	simxInt tempBufferBufferSize;
 	simxInt replyDataSize;
-	simxInt tmp,off,cmd,i,memSize,fullMemSize,memSize2;
-	simxUShort crc,pureDataOffset0;
-	simxInt pureDataOffset1,maxPureDataSize,pureDataSize;
-	simxInt lastTime,waitBeforeSendingAgainWhenMessageIDArrived_copy;
+	simxInt lastTime;
 	simxInt clientID=_clientIDForThread;
 	simxUChar usingSharedMem,connectionResult;
 	_clientIDForThread=-1; /* tell the simxStart function that we are set */
@@ -1704,21 +2250,8 @@ SIMX_THREAD_RET_TYPE _communicationThread(simxVoid* p)
 			{
 				/* printf("."); */
 				/* 1. Check if we should wait until the input buffer got read */
-				extApi_lockResources(clientID);
-				waitBeforeSendingAgainWhenMessageIDArrived_copy=_waitBeforeSendingAgainWhenMessageIDArrived[clientID];
-				extApi_unlockResources(clientID);
-				if ((waitBeforeSendingAgainWhenMessageIDArrived_copy!=-1)&&(_messageReceived_dataSize[clientID]>=SIMX_HEADER_SIZE))
-				{
-					while (1)
-					{
-						extApi_lockResources(clientID);
-						waitBeforeSendingAgainWhenMessageIDArrived_copy=_waitBeforeSendingAgainWhenMessageIDArrived[clientID];
-						extApi_unlockResources(clientID);
-						if ((_lastReceivedMessageID[clientID]<_waitBeforeSendingAgainWhenMessageIDArrived[clientID])||(waitBeforeSendingAgainWhenMessageIDArrived_copy==-1))
-							break;
-						extApi_switchThread();
-					}
-				}
+				while (_mustWaitForInputBufferRead(clientID))
+					extApi_switchThread();
 
 				/* 2. Make sure we don't send too many requests */
 				while (extApi_getTimeDiffInMs(lastTime)<_minCommunicationDelay[clientID])
@@ -1728,194 +2261,24 @@ SIMX_THREAD_RET_TYPE _communicationThread(simxVoid* p)
 				/* 3. Send a request */
 				extApi_lockResources(clientID);
 				extApi_unlockSendStart(clientID);
-				/* Take care of non-split commands first */
-				tempBuffer=extApi_allocateBuffer(_messageToSend_dataSize[clientID]);
-				for (i=0;i<_messageToSend_dataSize[clientID];i++)
-					tempBuffer[i]=_messageToSend[clientID][i];
-				tempBufferDataSize=_messageToSend_dataSize[clientID];
-				tempBufferBufferSize=tempBufferDataSize;
-				_messageToSend_dataSize[clientID]=SIMX_HEADER_SIZE; /* remove all non-split commands */
-				/* Take care of split commands here */
-				off=0;
-				while (off<_splitCommandsToSend_dataSize[clientID])
-				{
-					memSize=extApi_endianConversionInt(((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_mem_size))[0]);
-					pureDataOffset0=extApi_endianConversionUShort(((simxUShort*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset0))[0]);
-					pureDataOffset1=extApi_endianConversionInt(((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset1))[0]);
-					maxPureDataSize=extApi_endianConversionUShort(((simxUShort*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_delay_or_split))[0]);
-					pureDataSize=memSize-SIMX_SUBHEADER_SIZE-pureDataOffset0-pureDataOffset1;
-					if (pureDataSize>maxPureDataSize)
-						pureDataSize=maxPureDataSize;
-					tempBuffer=_appendChunkToBuffer(_splitCommandsToSend[clientID]+off,SIMX_SUBHEADER_SIZE+pureDataOffset0,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
-					tempBuffer=_appendChunkToBuffer(_splitCommandsToSend[clientID]+off+SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1,pureDataSize,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
-					((simxInt*)(tempBuffer+tempBufferDataSize-pureDataSize-pureDataOffset0-SIMX_SUBHEADER_SIZE+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataSize);
-					if (SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+pureDataSize>=memSize)
-					{ /* command completely sent, we can remove it */
-						_removeChunkFromBuffer(_splitCommandsToSend[clientID],_splitCommandsToSend[clientID]+off,memSize,&_splitCommandsToSend_dataSize[clientID]);
-					}
-					else
-					{ /* command not yet completely sent. Keep it, but adjust the pure data offset1 */
-						pureDataOffset1+=pureDataSize;
-						((simxInt*)(_splitCommandsToSend[clientID]+off+simx_cmdheaderoffset_pdata_offset1))[0]=extApi_endianConversionInt(pureDataOffset1);
-						off+=memSize;
-					}
-				}
-				/* Set some message header values */
-				tempBuffer[simx_headeroffset_version]=SIMX_VERSION;
-				((simxInt*)(tempBuffer+simx_headeroffset_message_id))[0]=extApi_endianConversionInt(_nextMessageIDToSend[clientID]++);
-				((simxInt*)(tempBuffer+simx_headeroffset_client_time))[0]=extApi_endianConversionInt(extApi_getTimeInMs());
-				/* CRC calculation represents a bottleneck for large transmissions, and is anyway not needed with tcp or shared memory transmissions */
-				/* ((simxUShort*)(tempBuffer+simx_headeroffset_crc))[0]=extApi_endianConversionUShort(_getCRC(tempBuffer+2,tempBufferDataSize-2)); */
-				((simxUShort*)(tempBuffer+simx_headeroffset_crc))[0]=extApi_endianConversionUShort(0);
+				tempBuffer=_buildRequestMessage(clientID,&tempBufferDataSize);
 				/* Send the message */
 				if (_sendMessage_socketOrSharedMem(clientID,tempBuffer,tempBufferDataSize,usingSharedMem)!=1)
 				{
-					extApi_releaseBuffer(tempBuffer);
 					extApi_unlockResources(clientID);
 					break;
 				}
-				extApi_releaseBuffer(tempBuffer);
 				extApi_unlockResources(clientID);
 				/* 4. Read the reply (the server always replies!) */
 				replyData=_receiveReplyMessage_socketOrSharedMem(clientID,&replyDataSize,usingSharedMem);
 				if (replyData==0)
 					break;
 
-				/* Check the CRC */
-				/* CRC calculation represents a bottleneck for large transmissions, and is anyway not needed with tcp or shared memory transmissions */
-				crc=extApi_endianConversionUShort(((simxUShort*)(replyData+simx_headeroffset_crc))[0]);
-				/* if (_getCRC(replyData+2,replyDataSize-2)==crc) */
-				if (1)
-				{
-					/* Place the reply into the input buffer */
-					tmp=extApi_endianConversionInt(((simxInt*)(replyData+simx_headeroffset_message_id))[0]);
-
-					if (replyDataSize>SIMX_HEADER_SIZE)
-					{ /* We received a non-empty message */
-						extApi_lockResources(clientID);
-						/* a) Create a new buffer that will hold the merged input data */
-						tempBuffer=extApi_allocateBuffer(_messageReceived_bufferSize[clientID]);
-						tempBufferBufferSize=_messageReceived_bufferSize[clientID];
-						/* b) Copy the header from the received data, or from the existing input buffer (if id is -1) */
-						if (tmp==-1)
-						{
-							for (i=0;i<SIMX_HEADER_SIZE;i++)
-								tempBuffer[i]=_messageReceived[clientID][i];
-						}
-						else
-						{
-							for (i=0;i<SIMX_HEADER_SIZE;i++)
-								tempBuffer[i]=replyData[i];
-						}
-						tempBufferDataSize=SIMX_HEADER_SIZE;
-
-						/* c) go through the received data and add it (either to the temp buffer, either to the partial command buffer) */
-						off=SIMX_HEADER_SIZE;
-						while (off<replyDataSize)
-						{
-							memSize=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]);
-							fullMemSize=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_full_mem_size))[0]);
-							if (memSize==fullMemSize)
-							{ /* the full data was sent at once! */
-								cmd=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_cmd))[0]);
-								if ((cmd-(cmd&simx_cmdmask))!=simx_opmode_discontinue) /* only discontinue mode commands are not added */
-								{
-									tempBuffer=_appendCommandToBufferAndTakeIntoAccountPreviouslyReceivedData(replyData+off,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE,replyData+off,extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]),tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
-									/* tempBuffer=_appendChunkToBuffer(replyData+off,extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]),tempBuffer,&tempBufferBufferSize,&tempBufferDataSize); */
-								}
-								cmdPointer=_getSameCommandPointer(replyData+off,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
-								if (cmdPointer!=0)
-								{ /* unmark this command (we already added its newer version) */
-									((simxInt*)(cmdPointer+simx_cmdheaderoffset_cmd))[0]=0;
-								}
-							}
-							else
-							{ /* only partial data was sent */
-								
-								/* Try to merge the partial data with same data already present in the partial commands buffer */
-								cmdPointer=_getSameCommandPointer(replyData+off,_splitCommandsReceived[clientID],_splitCommandsReceived_dataSize[clientID]);
-								if (cmdPointer!=0)
-								{ /* there is previous partial data. Is it valid? */
-									memSize2=extApi_endianConversionInt(((simxInt*)(cmdPointer+simx_cmdheaderoffset_mem_size))[0]);						
-									if (memSize2!=fullMemSize)
-									{ /* we cannot use the previous version, since it has a different size. Remove it */
-										_removeChunkFromBuffer(_splitCommandsReceived[clientID],cmdPointer,memSize2,&_splitCommandsReceived_dataSize[clientID]);
-										cmdPointer=0;
-									}
-								}
-								if (cmdPointer==0)
-								{ /* there is not yet similar data present. Just add empty space */
-									_splitCommandsReceived[clientID]=_appendChunkToBuffer(0,fullMemSize,_splitCommandsReceived[clientID],&_splitCommandsReceived_bufferSize[clientID],&_splitCommandsReceived_dataSize[clientID]);
-									cmdPointer=_splitCommandsReceived[clientID]+_splitCommandsReceived_dataSize[clientID]-fullMemSize;
-								}
-								/* Now we have to overwrite the subheader, the command data, and the partial data */
-								for (i=0;i<SIMX_SUBHEADER_SIZE;i++)
-									cmdPointer[i]=replyData[off+i];
-								((simxInt*)(cmdPointer+simx_cmdheaderoffset_mem_size))[0]=extApi_endianConversionInt(fullMemSize); /* Important!! */
-
-								pureDataOffset0=extApi_endianConversionUShort(((simxUShort*)(cmdPointer+simx_cmdheaderoffset_pdata_offset0))[0]);
-								for (i=0;i<pureDataOffset0;i++)
-									cmdPointer[SIMX_SUBHEADER_SIZE+i]=replyData[off+SIMX_SUBHEADER_SIZE+i];
-
-								pureDataOffset1=extApi_endianConversionInt(((simxInt*)(cmdPointer+simx_cmdheaderoffset_pdata_offset1))[0]);
-								pureDataSize=memSize-SIMX_SUBHEADER_SIZE-pureDataOffset0;
-								for (i=0;i<pureDataSize;i++)
-									cmdPointer[SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+i]=replyData[off+SIMX_SUBHEADER_SIZE+pureDataOffset0+i];
-
-								/* Is the partial data complete yet? */
-								if (SIMX_SUBHEADER_SIZE+pureDataOffset0+pureDataOffset1+pureDataSize>=fullMemSize)
-								{ /* yes!! Copy the data from the partial command buffer to the tempBuffer, and erase it from the partial command buffer */
-
-									tempBuffer=_appendCommandToBufferAndTakeIntoAccountPreviouslyReceivedData(tempBuffer+tempBufferDataSize-fullMemSize,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE,cmdPointer,fullMemSize,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
-									/* tempBuffer=_appendChunkToBuffer(cmdPointer,fullMemSize,tempBuffer,&tempBufferBufferSize,&tempBufferDataSize); */
-
-									_removeChunkFromBuffer(_splitCommandsReceived[clientID],cmdPointer,fullMemSize,&_splitCommandsReceived_dataSize[clientID]);
-									/* make sure we unmark any similar command in the _messageReceived[clientID] buffer */
-									cmdPointer=_getSameCommandPointer(tempBuffer+tempBufferDataSize-fullMemSize,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
-									if (cmdPointer!=0)
-									{ /* unmark this command (we already added its newer version) */
-										((simxInt*)(cmdPointer+simx_cmdheaderoffset_cmd))[0]=0;
-									}
-								}
-							}
-							off+=extApi_endianConversionInt(((simxInt*)(replyData+off+simx_cmdheaderoffset_mem_size))[0]);
-						}
-						/* d) go through the old received data, and add only commands that were not unmarked */
-						off=SIMX_HEADER_SIZE;
-						while (off<_messageReceived_dataSize[clientID])
-						{
-							cmd=extApi_endianConversionInt(((simxInt*)(_messageReceived[clientID]+off+simx_cmdheaderoffset_cmd))[0]);
-							if (cmd!=0)
-							{ /* ok, this command was not unmarked. We add it */
-								tempBuffer=_appendChunkToBuffer(_messageReceived[clientID]+off,extApi_endianConversionInt(((simxInt*)(_messageReceived[clientID]+off+simx_cmdheaderoffset_mem_size))[0]),tempBuffer,&tempBufferBufferSize,&tempBufferDataSize);
-							}
-							off+=extApi_endianConversionInt(((simxInt*)(_messageReceived[clientID]+off+simx_cmdheaderoffset_mem_size))[0]);
-						}
-						/* e) switch buffers and release 2 of them */
-						extApi_releaseBuffer(replyData);
-						extApi_releaseBuffer(_messageReceived[clientID]);
-						_messageReceived[clientID]=tempBuffer;
-						_messageReceived_bufferSize[clientID]=tempBufferBufferSize;
-						_messageReceived_dataSize[clientID]=tempBufferDataSize;
-						if (tmp!=-1)
-							_lastReceivedMessageID[clientID]=tmp;
-						extApi_unlockResources(clientID);
-					}
-					else
-						extApi_releaseBuffer(replyData);
-				}
-				else
+				_processReplyMessage(clientID,replyData,replyDataSize);
+				if (usingSharedMem)
 					extApi_releaseBuffer(replyData);
-
 			}
-			extApi_lockResources(clientID);
-			_messageToSend_dataSize[clientID]=SIMX_HEADER_SIZE;
-			_splitCommandsToSend_dataSize[clientID]=0;
-			_messageReceived_dataSize[clientID]=0;
-			_splitCommandsReceived_dataSize[clientID]=0;
-			extApi_unlockResources(clientID);
-			/* printf("Disconnected\n"); */
-			_connectionID[clientID]=-1;
+			_clearConnectionBuffers(clientID);
 
 			if (usingSharedMem)
 			{ /* using shared memory */
@@ -1941,6 +2304,275 @@ SIMX_THREAD_RET_TYPE _communicationThread(simxVoid* p)
 	SIMX_THREAD_RET_LINE;
 }
 
+#ifdef EXTAPI_EPOLL
+simxVoid _ioRegister(simxInt clientID)
+{ /* hand a socket connection over to the I/O engine thread, started with the first connection */
+	_ioConnection* c=&_ioConnections[clientID];
+	extApi_globalSimpleLock();
+	if (_ioEngineRunning==0)
+	{
+		if (extApi_createPoller())
+		{
+			extApi_launchThread(_ioEngineThread);
+			_ioEngineRunning=1;
+		}
+	}
+	c->state=IO_DISCONNECTED;
+	c->lastTime=extApi_getTimeInMs()-SOCKET_RECONNECT_DELAY; /* try to connect right away */
+	c->out=0;
+	c->pollingWritable=0;
+	c->registered=1;
+	_ioClients[_ioClientCount++]=clientID;
+	extApi_globalSimpleUnlock();
+	extApi_wakeUpPoller();
+}
+
+simxInt _ioUnregister(simxInt clientID)
+{ /* called from the I/O engine thread. Return the number of clients left: with none left, the poller is closed and the thread must end */
+	simxInt i,left;
+	extApi_globalSimpleLock();
+	for (i=0;i<_ioClientCount;i++)
+	{
+		if (_ioClients[i]==clientID)
+		{
+			_ioClients[i]=_ioClients[--_ioClientCount];
+			break;
+		}
+	}
+	left=_ioClientCount;
+	if (left==0)
+	{ /* the next _ioRegister starts a new thread */
+		extApi_closePoller();
+		_ioEngineRunning=0;
+	}
+	extApi_globalSimpleUnlock();
+	return(left);
+}
+
+simxVoid _ioDisconnect(simxInt clientID)
+{ /* close the connection (or the connection attempt) and release its buffers */
+	_ioConnection* c=&_ioConnections[clientID];
+	if ( (c->state==IO_IDLE)||(c->state==IO_SENDING)||(c->state==IO_RECEIVING) )
+		_clearConnectionBuffers(clientID);
+	if ( (c->state!=IO_DISCONNECTED)&&(c->state!=IO_CLOSED) )
+		extApi_cleanUp_socket(clientID);
+	c->out=0;
+	c->pollingWritable=0;
+	c->lastTime=extApi_getTimeInMs();
+	if (_tempDoNotReconnectOnceDisconnected[clientID])
+		c->state=IO_CLOSED;
+	else
+		c->state=IO_DISCONNECTED;
+}
+
+simxVoid _ioSend(simxInt clientID)
+{ /* send as much of the request as the socket accepts */
+	_ioConnection* c=&_ioConnections[clientID];
+	simxInt n;
+	while (c->outOffset<c->outSize)
+	{
+		n=_sendPackets_socket(clientID,c->out,c->outMessageSize,c->outOffset);
+		if (n<0)
+		{
+			if (extApi_wouldBlock())
+			{ /* wait until there is some room in the socket output buffer */
+				if (c->pollingWritable==0)
+					extApi_pollSocket(clientID,1);
+				c->pollingWritable=1;
+				return;
+			}
+			_ioDisconnect(clientID);
+			return;
+		}
+		c->outOffset+=n;
+		c->waitTime=extApi_getTimeInMs();
+	}
+	if (c->pollingWritable)
+		extApi_pollSocket(clientID,0);
+	c->pollingWritable=0;
+	_replyReceived_dataSize[clientID]=0;
+	c->waitTime=extApi_getTimeInMs();
+	c->waitingHeader=(_packetReceived_dataLeft[clientID]<0);
+	c->state=IO_RECEIVING;
+}
+
+simxVoid _ioReceive(simxInt clientID)
+{ /* read the available reply data, and process the reply once complete */
+	_ioConnection* c=&_ioConnections[clientID];
+	simxInt n;
+	while (c->state==IO_RECEIVING)
+	{
+		if (_takeReplyFromRing(clientID))
+		{ /* the reply is complete */
+			c->state=IO_IDLE;
+			_processReplyMessage(clientID,_replyReceived[clientID],_replyReceived_dataSize[clientID]);
+			return;
+		}
+		if ((_packetReceived_dataLeft[clientID]<0)!=c->waitingHeader)
+		{ /* a header was read or a packet completed since the last check */
+			c->waitTime=extApi_getTimeInMs();
+			c->waitingHeader=(_packetReceived_dataLeft[clientID]<0);
+		}
+		n=_receiveToRing_socket(clientID);
+		if (n<0)
+		{
+			if (extApi_wouldBlock()==0)
+				_ioDisconnect(clientID);
+			return;
+		}
+		if (n==0)
+		{ /* connection closed by the server */
+			_ioDisconnect(clientID);
+			return;
+		}
+	}
+}
+
+simxInt _ioUpdate(simxInt clientID)
+{ /* start a connection or send a request if it is time to. Return the time before the next check (ms), -1 if only socket events matter */
+	_ioConnection* c=&_ioConnections[clientID];
+	simxUChar* message;
+	simxInt messageSize,elapsed,timeOut;
+
+	if (c->state==IO_DISCONNECTED)
+	{
+		elapsed=extApi_getTimeDiffInMs(c->lastTime);
+		if (elapsed<SOCKET_RECONNECT_DELAY)
+			return(SOCKET_RECONNECT_DELAY-elapsed);
+		if (extApi_startConnectToServer_socket(clientID,_tempConnectionAddress[clientID],_tempConnectionPort[clientID]))
+		{
+			c->waitTime=extApi_getTimeInMs();
+			c->state=IO_CONNECTING;
+			return(SOCKET_TIMEOUT_READ);
+		}
+		_ioDisconnect(clientID);
+		if (c->state==IO_DISCONNECTED)
+			return(SOCKET_RECONNECT_DELAY);
+		return(-1);
+	}
+
+	if ( (c->state==IO_CONNECTING)||(c->state==IO_SENDING)||(c->state==IO_RECEIVING) )
+	{ /* same limits as the blocking receive: SOCKET_TIMEOUT_READ ms without progress, SOCKET_TIMEOUT_READ_DATA ms for the data of a reply packet */
+		timeOut=SOCKET_TIMEOUT_READ;
+		if ( (c->state==IO_RECEIVING)&&(c->waitingHeader==0) )
+			timeOut=SOCKET_TIMEOUT_READ_DATA;
+		elapsed=extApi_getTimeDiffInMs(c->waitTime);
+		if (elapsed<timeOut)
+			return(timeOut-elapsed);
+		_ioDisconnect(clientID);
+		if (c->state==IO_DISCONNECTED)
+			return(SOCKET_RECONNECT_DELAY);
+		return(-1);
+	}
+
+	if (c->state!=IO_IDLE)
+		return(-1);
+
+	/* 1. Check if we should wait until the input buffer got read (the poller is woken up once it is) */
+	if (_mustWaitForInputBufferRead(clientID))
+		return(-1);
+
+	/* 2. Make sure we don't send too many requests */
+	elapsed=extApi_getTimeDiffInMs(c->lastTime);
+	if (elapsed<_minCommunicationDelay[clientID])
+		return(_minCommunicationDelay[clientID]-elapsed);
+
+	/* 3. Send a request, unless several commands are being queued (simxPauseCommunication wakes the poller up once done) */
+	if (extApi_tryLockSendStart(clientID)==0)
+		return(-1);
+	c->lastTime=extApi_getTimeInMs();
+	extApi_lockResources(clientID);
+	extApi_unlockSendStart(clientID);
+	message=_buildRequestMessage(clientID,&messageSize);
+	extApi_unlockResources(clientID);
+	/* the request buffer stays untouched until the next request is built, it is sent from there */
+	c->out=message;
+	c->outMessageSize=messageSize;
+	c->outSize=messageSize+((messageSize+SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH-1)/(SOCKET_MAX_PACKET_SIZE-SOCKET_HEADER_LENGTH))*SOCKET_HEADER_LENGTH;
+	c->outOffset=0;
+	c->waitTime=c->lastTime;
+	c->state=IO_SENDING;
+	_ioSend(clientID);
+
+	/* 4. The reply is read as soon as it arrives, until it times out */
+	return(_ioUpdate(clientID));
+}
+
+SIMX_THREAD_RET_TYPE _ioEngineThread(simxVoid* p)
+{ /* services all the socket connections, until the last one is finished */
+	simxInt clients[MAX_EXT_API_CONNECTIONS];
+	simxInt clientIDs[64];
+	simxUChar events[64];
+	simxInt clientID,clientCount,running,i,n,count,timeOut,t;
+	simxUChar data;
+	_ioConnection* c;
+	(void)p;
+	running=1;
+	while (running)
+	{
+		extApi_globalSimpleLock();
+		clientCount=_ioClientCount;
+		memcpy(clients,_ioClients,clientCount*sizeof(simxInt));
+		extApi_globalSimpleUnlock();
+		timeOut=-1;
+		for (i=0;i<clientCount;i++)
+		{
+			clientID=clients[i];
+			c=&_ioConnections[clientID];
+			if (_communicationThreadRunning[clientID]==0)
+			{ /* simxFinish is waiting for us */
+				_ioDisconnect(clientID);
+				c->registered=0;
+				running=(_ioUnregister(clientID)!=0);
+				_communicationThreadRunning[clientID]=1; /* to indicate to the main thread that we just left */
+				continue;
+			}
+			t=_ioUpdate(clientID);
+			if ( (t>=0)&&((timeOut<0)||(t<timeOut)) )
+				timeOut=t;
+		}
+		if (running==0)
+			break; /* the poller is closed already */
+
+		count=extApi_waitForSockets(clientIDs,events,64,timeOut);
+		for (i=0;i<count;i++)
+		{
+			clientID=clientIDs[i];
+			c=&_ioConnections[clientID];
+			if (c->registered==0)
+				continue;
+			switch (c->state)
+			{
+			case IO_CONNECTING:
+				if (extApi_isConnected_socket(clientID))
+				{
+					_connectionID[clientID]=_nextConnectionID[clientID]++;
+					c->lastTime=extApi_getTimeInMs()-_minCommunicationDelay[clientID]; /* first request right away */
+					c->state=IO_IDLE;
+					extApi_pollSocket(clientID,0);
+				}
+				else
+					_ioDisconnect(clientID);
+				break;
+			case IO_SENDING:
+				_ioSend(clientID);
+				break;
+			case IO_RECEIVING:
+				_ioReceive(clientID);
+				break;
+			case IO_IDLE:
+				/* the server never talks first: the connection has been closed */
+				n=extApi_recv_socket(clientID,&data,1);
+				if ( (n==0)||((n<0)&&(extApi_wouldBlock()==0)) )
+					_ioDisconnect(clientID);
+				break;
+			}
+		}
+	}
+	SIMX_THREAD_RET_LINE;
+}
+#endif
+
 simxUShort _getCRC(const simxUChar* data,simxInt length)
 {
 	simxUShort crc=0;
@@ -1966,12 +2598,12 @@ simxInt _removeCommandReply_null(simxInt clientID,simxInt cmdRaw)
 	simxUChar* cmdPtr;
 	simxInt retVal=simx_return_ok;
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_(cmdRaw,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_(clientID,cmdRaw);
 	if (cmdPtr!=0)
-		_removeChunkFromBuffer(_messageReceived[clientID],cmdPtr,extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_mem_size))[0]),&_messageReceived_dataSize[clientID]);
+		_removeReceivedCommand(clientID,cmdPtr);
 	else
 		retVal=simx_return_novalue_flag;
-	/* Data is removed, but buffer keeps same size. It will be resized next time we receive something */
+	/* Data is marked as removed, the buffer gets compacted once enough of it is */
 	extApi_unlockResources(clientID);
 	return(retVal);
 }
@@ -1981,12 +2613,12 @@ simxInt _removeCommandReply_int(simxInt clientID,simxInt cmdRaw,simxInt intValue
 	simxUChar* cmdPtr;
 	simxInt retVal=simx_return_ok;
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_i(cmdRaw,intValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_i(clientID,cmdRaw,intValue);
 	if (cmdPtr!=0)
-		_removeChunkFromBuffer(_messageReceived[clientID],cmdPtr,extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_mem_size))[0]),&_messageReceived_dataSize[clientID]);
+		_removeReceivedCommand(clientID,cmdPtr);
 	else
 		retVal=simx_return_novalue_flag;
-	/* Data is removed, but buffer keeps same size. It will be resized next time we receive something */
+	/* Data is marked as removed, the buffer gets compacted once enough of it is */
 	extApi_unlockResources(clientID);
 	return(retVal);
 }
@@ -1996,12 +2628,12 @@ simxInt _removeCommandReply_intint(simxInt clientID,simxInt cmdRaw,simxInt intVa
 	simxUChar* cmdPtr;
 	simxInt retVal=simx_return_ok;
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_ii(cmdRaw,intValue1,intValue2,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_ii(clientID,cmdRaw,intValue1,intValue2);
 	if (cmdPtr!=0)
-		_removeChunkFromBuffer(_messageReceived[clientID],cmdPtr,extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_mem_size))[0]),&_messageReceived_dataSize[clientID]);
+		_removeReceivedCommand(clientID,cmdPtr);
 	else
 		retVal=simx_return_novalue_flag;
-	/* Data is removed, but buffer keeps same size. It will be resized next time we receive something */
+	/* Data is marked as removed, the buffer gets compacted once enough of it is */
 	extApi_unlockResources(clientID);
 	return(retVal);
 }
@@ -2011,12 +2643,12 @@ simxInt _removeCommandReply_string(simxInt clientID,simxInt cmdRaw,const simxUCh
 	simxUChar* cmdPtr;
 	simxInt retVal=simx_return_ok;
 	extApi_lockResources(clientID);
-	cmdPtr=_getCommandPointer_s(cmdRaw,stringValue,_messageReceived[clientID]+SIMX_HEADER_SIZE,_messageReceived_dataSize[clientID]-SIMX_HEADER_SIZE);
+	cmdPtr=_getReceivedCommandPointer_s(clientID,cmdRaw,stringValue);
 	if (cmdPtr!=0)
-		_removeChunkFromBuffer(_messageReceived[clientID],cmdPtr,extApi_endianConversionInt(((simxInt*)(cmdPtr+simx_cmdheaderoffset_mem_size))[0]),&_messageReceived_dataSize[clientID]);
+		_removeReceivedCommand(clientID,cmdPtr);
 	else
 		retVal=simx_return_novalue_flag;
-	/* Data is removed, but buffer keeps same size. It will be resized next time we receive something */
+	/* Data is marked as removed, the buffer gets compacted once enough of it is */
 	extApi_unlockResources(clientID);
 	return(retVal);
 }
@@ -2047,6 +2679,12 @@ EXTAPI_DLLEXPORT simxInt simxGetPingTime(simxInt clientID,simxInt* pingTime)
 	return(res);
 }
 
+EXTAPI_DLLEXPORT simxInt simxGetAllocationCounters(simxInt* allocationCount,simxInt* releaseCount)
+{ /* buffers allocated and released by the remote API since the start. Once connected, streaming shouldn't allocate anything anymore */
+	extApi_getAllocationCounters(allocationCount,releaseCount);
+	return(simx_return_ok);
+}
+
 EXTAPI_DLLEXPORT simxInt simxSynchronousTrigger(simxInt clientID)
 {
 	simxInt returnValue;
@@ -2075,7 +2713,12 @@ EXTAPI_DLLEXPORT simxInt simxPauseCommunication(simxInt clientID,simxUChar pause
 	if (pause)
 		extApi_lockSendStart(clientID);
 	else
+	{
 		extApi_unlockSendStart(clientID);
+#ifdef EXTAPI_EPOLL
+		extApi_wakeUpPoller(); /* the I/O engine thread can send the queued commands */
+#endif
+	}
 	return(0);
 }
 
@@ -2112,6 +2755,18 @@ EXTAPI_DLLEXPORT simxInt simxGetInMessageInfo(simxInt clientID,simxInt infoType,
 	return(retVal);
 }
 
+EXTAPI_DLLEXPORT simxInt simxSetInMessageCallback(simxInt clientID,simxVoid (*callback)(simxInt,simxVoid*),simxVoid* userData)
+{ /* callback is called from the communication thread each time a non-empty reply was placed into the input buffer. Use 0 to remove it.
+     With EXTAPI_EPOLL, that thread services all the connections: the callback must return quickly */
+	if (_communicationThreadRunning[clientID]==0)
+		return(simx_return_initialize_error_flag);
+	extApi_lockResources(clientID);
+	_inMessageCallback[clientID]=callback;
+	_inMessageCallbackUserData[clientID]=userData;
+	extApi_unlockResources(clientID);
+	return(simx_return_ok);
+}
+
 EXTAPI_DLLEXPORT simxInt simxGetOutMessageInfo(simxInt clientID,simxInt infoType,simxInt* info)
 {
 	simxInt retVal=-1;
@@ -83,6 +83,21 @@ simxUChar* _getCommandPointer_i(simxInt cmdRaw,simxInt intValue,const simxUChar*
 simxUChar* _getCommandPointer_ii(simxInt cmdRaw,simxInt intValue1,simxInt intValue2,const simxUChar* commandBufferStart,simxInt commandBufferSize);
 simxUChar* _getCommandPointer_s(simxInt cmdRaw,const simxUChar* stringValue,const simxUChar* commandBufferStart,simxInt commandBufferSize);
 
+simxInt _getCmdKeyType(simxInt cmdRaw);
+simxUInt _getCmdKeyHash(simxInt cmdRaw,simxInt keyType,const simxUChar* key);
+simxUChar _isCmdKeySame(simxInt cmdRaw,simxInt keyType,const simxUChar* key,const simxUChar* cmdPtr);
+simxVoid _indexReceivedCommands(simxInt clientID);
+simxVoid _indexReceivedCommand(simxInt clientID,simxInt off);
+simxUChar* _getIndexedCommandPointer(simxInt clientID,simxInt cmdRaw,simxInt keyType,const simxUChar* key);
+simxUChar* _getReceivedCommandPointer_(simxInt clientID,simxInt cmdRaw);
+simxUChar* _getReceivedCommandPointer_i(simxInt clientID,simxInt cmdRaw,simxInt intValue);
+simxUChar* _getReceivedCommandPointer_ii(simxInt clientID,simxInt cmdRaw,simxInt intValue1,simxInt intValue2);
+simxUChar* _getReceivedCommandPointer_s(simxInt clientID,simxInt cmdRaw,const simxUChar* stringValue);
+simxUChar* _getSameReceivedCommandPointer(simxInt clientID,const simxUChar* cmdPtr);
+simxVoid _compactReceivedCommands(simxInt clientID);
+simxVoid _removeReceivedCommand(simxInt clientID,simxUChar* cmdPtr);
+simxVoid _mergeReceivedCommand(simxInt clientID,const simxUChar* cmdPtr,simxInt cmdSize);
+
 simxUChar* _appendCommand_(simxInt cmd,simxUChar options,simxUShort delayOrSplit,simxUChar* buffer,simxInt* buffer_bufferSize,simxInt* buffer_dataSize);
 simxUChar* _appendCommand_null_buff(simxInt cmd,simxUChar options,simxUChar* buffer,simxInt bufferSize,simxUShort delayOrSplit,simxUChar* destBuffer,simxInt* destBuffer_bufferSize,simxInt* destBuffer_dataSize);
 simxUChar* _appendCommand_i(simxInt cmd,simxUChar options,simxInt intValue,simxUShort delayOrSplit,simxUChar* buffer,simxInt* buffer_bufferSize,simxInt* buffer_dataSize);
@@ -98,8 +113,6 @@ simxUChar* _appendCommand_s_buff(simxInt cmd,simxUChar options,const simxUChar*
 simxUChar* _appendChunkToBuffer(const simxUChar* chunk,simxInt chunkSize,simxUChar* buffer,simxInt* buffer_bufferSize,simxInt* buffer_dataSize);
 simxVoid _removeChunkFromBuffer(const simxUChar* bufferStart,simxUChar* chunkStart,simxInt chunkSize,simxInt* buffer_dataSize);
 
-simxUChar* _appendCommandToBufferAndTakeIntoAccountPreviouslyReceivedData(const simxUChar* cmdPtr,simxUChar* cmdBuffer,simxInt cmdBufferSize,const simxUChar* chunk,simxInt chunkSize,simxUChar* buffer,simxInt* buffer_bufferSize,simxInt* buffer_dataSize);
-
 simxInt _removeCommandReply_null(simxInt clientID,simxInt cmdRaw);
 simxInt _removeCommandReply_int(simxInt clientID,simxInt cmdRaw,simxInt intValue);
 simxInt _removeCommandReply_intint(simxInt clientID,simxInt cmdRaw,simxInt intValue1,simxInt intValue2);
@@ -107,13 +120,28 @@ simxInt _removeCommandReply_string(simxInt clientID,simxInt cmdRaw,const simxUCh
 
 simxUChar* _getSameCommandPointer(const simxUChar* cmdPtr,simxUChar* cmdBuffer,simxInt cmdBufferSize);
 SIMX_THREAD_RET_TYPE _communicationThread(simxVoid* p);
+simxUChar* _buildRequestMessage(simxInt clientID,simxInt* messageSize);
+simxVoid _processReplyMessage(simxInt clientID,simxUChar* replyData,simxInt replyDataSize);
+simxUChar _mustWaitForInputBufferRead(simxInt clientID);
+simxVoid _clearConnectionBuffers(simxInt clientID);
+
+#ifdef EXTAPI_EPOLL
+simxVoid _ioRegister(simxInt clientID);
+simxInt _ioUnregister(simxInt clientID);
+simxVoid _ioDisconnect(simxInt clientID);
+simxVoid _ioSend(simxInt clientID);
+simxVoid _ioReceive(simxInt clientID);
+simxInt _ioUpdate(simxInt clientID);
+SIMX_THREAD_RET_TYPE _ioEngineThread(simxVoid* p);
+#endif
 
 simxUShort _getCRC(const simxUChar* data,simxInt length);
 
 simxUChar _sendMessage_socketOrSharedMem(simxInt clientID,const simxUChar* message,simxInt messageSize,simxUChar usingSharedMem);
 simxUChar* _receiveReplyMessage_socketOrSharedMem(simxInt clientID,simxInt* messageSize,simxUChar usingSharedMem);
-simxUChar _sendSimplePacket_socket(simxInt clientID,const simxUChar* packet,simxShort packetLength,simxShort packetsLeft);
-simxInt _receiveSimplePacket_socket(simxInt clientID,simxUChar** packet,simxShort* packetSize);
+simxInt _sendPackets_socket(simxInt clientID,const simxUChar* message,simxInt messageSize,simxInt offset);
+simxInt _receiveToRing_socket(simxInt clientID);
+simxInt _takeReplyFromRing(simxInt clientID);
 
 #endif /* NON_MATLAB_PARSING */
 
@@ -223,10 +251,12 @@ EXTAPI_DLLEXPORT simxVoid simxFinish(simxInt clientID);
 /* The remote API helper functions */
 EXTAPI_DLLEXPORT simxInt simxGetPingTime(simxInt clientID,simxInt* pingTime);
 EXTAPI_DLLEXPORT simxInt simxGetLastCmdTime(simxInt clientID);
+EXTAPI_DLLEXPORT simxInt simxGetAllocationCounters(simxInt* allocationCount,simxInt* releaseCount);
 EXTAPI_DLLEXPORT simxInt simxSynchronousTrigger(simxInt clientID);
 EXTAPI_DLLEXPORT simxInt simxSynchronous(simxInt clientID,simxUChar enable);
 EXTAPI_DLLEXPORT simxInt simxPauseCommunication(simxInt clientID,simxUChar pause);
 EXTAPI_DLLEXPORT simxInt simxGetInMessageInfo(simxInt clientID,simxInt infoType,simxInt* info);
+EXTAPI_DLLEXPORT simxInt simxSetInMessageCallback(simxInt clientID,simxVoid (*callback)(simxInt,simxVoid*),simxVoid* userData);
 EXTAPI_DLLEXPORT simxInt simxGetOutMessageInfo(simxInt clientID,simxInt infoType,simxInt* info);
 EXTAPI_DLLEXPORT simxInt simxGetConnectionId(simxInt clientID);
 EXTAPI_DLLEXPORT simxUChar* simxCreateBuffer(simxInt bufferSize);
@@ -33,6 +33,14 @@
 
 #define SIMX_INIT_BUFF_SIZE 500
 #define SIMX_MIN_BUFF_INCR 500
+#define SIMX_MIN_INDEX_SIZE 64 /* power of 2 */
+#define SIMX_RECEIVE_RING_SIZE 65536 /* power of 2 */
+
+/* What identifies a command beside its id, see _getSameCommandPointer */
+#define SIMX_KEY_NONE 0
+#define SIMX_KEY_INT 1
+#define SIMX_KEY_INTINT 2
+#define SIMX_KEY_STRING 3
 
 #define _REPLY_WAIT_TIMEOUT_IN_MS 5000
 #define _MIN_SPLIT_AMOUNT_IN_BYTES 100
@@ -47,16 +55,38 @@ simxUChar* _splitCommandsToSend[MAX_EXT_API_CONNECTIONS];
 simxInt _splitCommandsToSend_bufferSize[MAX_EXT_API_CONNECTIONS];
 simxInt _splitCommandsToSend_dataSize[MAX_EXT_API_CONNECTIONS];
 
+/* Last request sent (swapped with the out buffer each time a request is built, to avoid copying it) */
+simxUChar* _messageSent[MAX_EXT_API_CONNECTIONS];
+simxInt _messageSent_bufferSize[MAX_EXT_API_CONNECTIONS];
+
 /* In buffer for messages */
 simxUChar* _messageReceived[MAX_EXT_API_CONNECTIONS];
 simxInt _messageReceived_bufferSize[MAX_EXT_API_CONNECTIONS];
 simxInt _messageReceived_dataSize[MAX_EXT_API_CONNECTIONS];
+simxInt _messageReceived_deadDataSize[MAX_EXT_API_CONNECTIONS]; /* replaced or removed commands (cmd set to 0) not compacted yet */
+
+/* Hash index of the commands in the in buffer: offset of each command (0 for a free slot), open addressing */
+simxInt* _messageReceived_index[MAX_EXT_API_CONNECTIONS];
+simxInt _messageReceived_indexSize[MAX_EXT_API_CONNECTIONS];
+simxInt _messageReceived_indexCount[MAX_EXT_API_CONNECTIONS]; /* used slots, including the ones of removed commands */
 
 /* Temp buffer for split commands received */
 simxUChar* _splitCommandsReceived[MAX_EXT_API_CONNECTIONS];
 simxInt _splitCommandsReceived_bufferSize[MAX_EXT_API_CONNECTIONS];
 simxInt _splitCommandsReceived_dataSize[MAX_EXT_API_CONNECTIONS];
 
+/* Reply being received by the communication thread (the buffer is reused for each reply) */
+simxUChar* _replyReceived[MAX_EXT_API_CONNECTIONS];
+simxInt _replyReceived_bufferSize[MAX_EXT_API_CONNECTIONS];
+simxInt _replyReceived_dataSize[MAX_EXT_API_CONNECTIONS];
+simxInt _packetReceived_dataLeft[MAX_EXT_API_CONNECTIONS]; /* data bytes of the current packet not received yet, -1 while waiting for its header */
+simxInt _packetReceived_packetsLeft[MAX_EXT_API_CONNECTIONS];
+
+/* Data read from the socket but not parsed yet (ring buffer) */
+simxUChar* _receiveRing[MAX_EXT_API_CONNECTIONS];
+simxInt _receiveRing_start[MAX_EXT_API_CONNECTIONS];
+simxInt _receiveRing_dataSize[MAX_EXT_API_CONNECTIONS];
+
 /* Temp buffer for last fetched command */
 simxUChar* _commandReceived[MAX_EXT_API_CONNECTIONS];
 simxInt _commandReceived_bufferSize[MAX_EXT_API_CONNECTIONS];
@@ -79,4 +109,38 @@ const simxChar* _tempConnectionAddress[MAX_EXT_API_CONNECTIONS];
 simxInt _tempConnectionPort[MAX_EXT_API_CONNECTIONS];
 simxUChar _tempDoNotReconnectOnceDisconnected[MAX_EXT_API_CONNECTIONS];
 
+/* Notification of new replies in the input buffer */
+simxVoid (*_inMessageCallback[MAX_EXT_API_CONNECTIONS])(simxInt,simxVoid*);
+simxVoid* _inMessageCallbackUserData[MAX_EXT_API_CONNECTIONS];
+
+#ifdef EXTAPI_EPOLL
+/* State of the socket connections serviced by the I/O engine thread */
+#define IO_DISCONNECTED 0	/* waiting before the next connection attempt */
+#define IO_CONNECTING 1		/* non-blocking connection in progress */
+#define IO_IDLE 2			/* connected, waiting for the next request */
+#define IO_SENDING 3		/* request partially sent */
+#define IO_RECEIVING 4		/* waiting for the (rest of the) reply */
+#define IO_CLOSED 5			/* disconnected and not allowed to reconnect */
+#define SOCKET_RECONNECT_DELAY 100 /* in ms */
+
+typedef struct
+{
+	simxUChar registered;
+	simxUChar state;
+	simxInt lastTime;			/* time of the last request or connection attempt */
+	simxInt waitTime;			/* time the connection, the request or the current reply packet started to be waited for */
+	simxUChar waitingHeader;	/* the reply packet header was not received yet at waitTime */
+	const simxUChar* out;		/* request being sent (the request buffer of the client) */
+	simxInt outMessageSize;
+	simxInt outSize;			/* size of the request split into packets, headers included */
+	simxInt outOffset;
+	simxUChar pollingWritable;	/* the socket is watched for free space in its output buffer */
+} _ioConnection;
+
+_ioConnection _ioConnections[MAX_EXT_API_CONNECTIONS];
+simxInt _ioClients[MAX_EXT_API_CONNECTIONS]; /* registered clients, serviced by the thread */
+simxInt _ioClientCount;
+simxUChar _ioEngineRunning;
+#endif
+
 #endif /* __EXTAPIINTERNAL_ */
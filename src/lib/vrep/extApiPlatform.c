@@ -30,6 +30,7 @@
 #include <stdio.h>
 
 #ifdef _WIN32
+	#include <winsock2.h> /* for WSASend, must come before Windows.h */
 	#include <Windows.h>
 	#include <process.h>
 	#ifndef QT_COMPIL
@@ -54,6 +55,7 @@
 	#include <netinet/in.h>
 	#include <sys/time.h>
 	#include <sys/socket.h>
+	#include <sys/uio.h>
 	#include <arpa/inet.h>
 	#include <netdb.h>
 	#define MUTEX_HANDLE pthread_mutex_t
@@ -76,9 +78,21 @@ MUTEX_HANDLE _mutex2Aux[MAX_EXT_API_CONNECTIONS];
 simxInt _mutex2LockLevel[MAX_EXT_API_CONNECTIONS];
 THREAD_ID _lock2ThreadId[MAX_EXT_API_CONNECTIONS];
 
+/* Buffers allocated and released since the start, by all the clients */
+volatile long _allocationCount=0;
+volatile long _releaseCount=0;
+
 SOCKET _socketConn[MAX_EXT_API_CONNECTIONS];
 struct sockaddr_in _socketServer[MAX_EXT_API_CONNECTIONS];
 
+#ifdef EXTAPI_EPOLL
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <errno.h>
+	int _poller=-1;
+	int _pollerWakeUp=-1;
+#endif
+
 #ifdef USE_ALSO_SHARED_MEMORY
 	#ifdef _WIN32
 
@@ -245,14 +259,33 @@ simxUChar* extApi_readFile(const simxChar* fileName,simxInt* len)
 
 simxUChar* extApi_allocateBuffer(simxInt bufferSize)
 {
+#ifdef _WIN32
+	InterlockedIncrement(&_allocationCount);
+#elif defined (__linux) || defined (__APPLE__)
+	__sync_fetch_and_add(&_allocationCount,1);
+#endif
 	return ((simxUChar*) (malloc(bufferSize)));
 }
 
 simxVoid extApi_releaseBuffer(simxUChar* buffer)
 {
+	if (buffer!=0)
+	{
+#ifdef _WIN32
+		InterlockedIncrement(&_releaseCount);
+#elif defined (__linux) || defined (__APPLE__)
+		__sync_fetch_and_add(&_releaseCount,1);
+#endif
+	}
 	free(buffer);
 }
 
+simxVoid extApi_getAllocationCounters(simxInt* allocationCount,simxInt* releaseCount)
+{
+	allocationCount[0]=(simxInt)_allocationCount;
+	releaseCount[0]=(simxInt)_releaseCount;
+}
+
 simxVoid extApi_createMutexes(simxInt clientID)
 {
 #ifdef _WIN32
@@ -461,6 +494,27 @@ simxVoid extApi_unlockSendStart(simxInt clientID)
 #endif
 }
 
+#ifdef EXTAPI_EPOLL
+simxUChar extApi_tryLockSendStart(simxInt clientID)
+{ /* return 1: locked, 0: already locked by another thread */
+	_simpleLock(&_mutex2Aux[clientID]);
+	if ( (pthread_self()==_lock2ThreadId[clientID]) && (_mutex2LockLevel[clientID]>0) )
+	{ // Already locked by this thread
+		_mutex2LockLevel[clientID]++;
+		_simpleUnlock(&_mutex2Aux[clientID]);
+		return(1);
+	}
+	_simpleUnlock(&_mutex2Aux[clientID]);
+	if (pthread_mutex_trylock(&_mutex2[clientID])!=0)
+		return(0);
+	_simpleLock(&_mutex2Aux[clientID]);
+	_lock2ThreadId[clientID]=pthread_self();
+	_mutex2LockLevel[clientID]=1;
+	_simpleUnlock(&_mutex2Aux[clientID]);
+	return(1);
+}
+#endif
+
 simxUChar extApi_launchThread(SIMX_THREAD_RET_TYPE(*startAddress)(simxVoid*))
 {
 #ifdef _WIN32
@@ -544,12 +598,181 @@ simxInt extApi_send_socket(simxInt clientID,const simxUChar* data,simxInt dataLe
 	return(send(_socketConn[clientID],(char*)data,dataLength,0));
 }
 
+simxInt extApi_sendGather_socket(simxInt clientID,const simxUChar** chunks,const simxInt* chunkSizes,simxInt chunkCount)
+{ /* sends the chunks one after the other with a single system call, without copying them. At most 2*SOCKET_MAX_GATHER_PACKETS chunks */
+#ifdef _WIN32
+	WSABUF buffers[2*SOCKET_MAX_GATHER_PACKETS];
+	DWORD sent;
+	simxInt i;
+	for (i=0;i<chunkCount;i++)
+	{
+		buffers[i].buf=(char*)chunks[i];
+		buffers[i].len=chunkSizes[i];
+	}
+	if (WSASend(_socketConn[clientID],buffers,chunkCount,&sent,0,0,0)!=0)
+		return(-1);
+	return((simxInt)sent);
+#elif defined (__linux) || defined (__APPLE__)
+	struct iovec vectors[2*SOCKET_MAX_GATHER_PACKETS];
+	struct msghdr message;
+	simxInt i;
+	for (i=0;i<chunkCount;i++)
+	{
+		vectors[i].iov_base=(void*)chunks[i];
+		vectors[i].iov_len=chunkSizes[i];
+	}
+	memset(&message,0,sizeof(message));
+	message.msg_iov=vectors;
+	message.msg_iovlen=chunkCount;
+	return((simxInt)sendmsg(_socketConn[clientID],&message,0));
+#endif
+}
+
 simxInt extApi_recv_socket(simxInt clientID,simxUChar* data,simxInt maxDataLength)
 {
 	return(recv(_socketConn[clientID],(char*)data,maxDataLength,0));
 }
 
+simxInt extApi_recvScatter_socket(simxInt clientID,simxUChar** chunks,const simxInt* chunkSizes,simxInt chunkCount)
+{ /* reads the available data into the chunks one after the other, with a single system call. At most 3 chunks */
+#ifdef _WIN32
+	WSABUF buffers[3];
+	DWORD received;
+	DWORD flags=0;
+	simxInt i;
+	for (i=0;i<chunkCount;i++)
+	{
+		buffers[i].buf=(char*)chunks[i];
+		buffers[i].len=chunkSizes[i];
+	}
+	if (WSARecv(_socketConn[clientID],buffers,chunkCount,&received,&flags,0,0)!=0)
+		return(-1);
+	return((simxInt)received);
+#elif defined (__linux) || defined (__APPLE__)
+	struct iovec vectors[3];
+	simxInt i;
+	for (i=0;i<chunkCount;i++)
+	{
+		vectors[i].iov_base=chunks[i];
+		vectors[i].iov_len=chunkSizes[i];
+	}
+	return((simxInt)readv(_socketConn[clientID],vectors,chunkCount));
+#endif
+}
+
+
+#ifdef EXTAPI_EPOLL
+simxUChar extApi_createPoller()
+{ /* return 1: success */
+	struct epoll_event ev;
+	_poller=epoll_create1(EPOLL_CLOEXEC);
+	if (_poller==-1)
+		return(0);
+	_pollerWakeUp=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+	if (_pollerWakeUp==-1)
+	{
+		close(_poller);
+		_poller=-1;
+		return(0);
+	}
+	ev.events=EPOLLIN;
+	ev.data.u32=MAX_EXT_API_CONNECTIONS; /* not a client ID */
+	epoll_ctl(_poller,EPOLL_CTL_ADD,_pollerWakeUp,&ev);
+	return(1);
+}
+
+simxVoid extApi_closePoller()
+{
+	simxInt wakeUp=_pollerWakeUp;
+	_pollerWakeUp=-1; /* extApi_wakeUpPoller does nothing from now on */
+	close(wakeUp);
+	close(_poller);
+	_poller=-1;
+}
+
+simxVoid extApi_wakeUpPoller()
+{
+	uint64_t one=1;
+	if (_pollerWakeUp!=-1)
+		write(_pollerWakeUp,&one,sizeof(one));
+}
+
+simxUChar extApi_startConnectToServer_socket(simxInt clientID,const simxChar* theConnectionAddress,simxInt theConnectionPort)
+{ /* return 1: connected or connection in progress (the socket becomes writable once done), 0: failure */
+	struct epoll_event ev;
+	_socketConn[clientID]=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,IPPROTO_TCP);
+	if(_socketConn[clientID]==INVALID_SOCKET)
+		return(0);
+	_socketServer[clientID].sin_addr.s_addr=inet_addr(theConnectionAddress);
+	_socketServer[clientID].sin_family=AF_INET;
+	_socketServer[clientID].sin_port=htons(theConnectionPort);
+	if ( (connect(_socketConn[clientID],(struct sockaddr*)&_socketServer[clientID],sizeof(_socketServer[clientID]))!=0)&&(errno!=EINPROGRESS) )
+	{
+		close(_socketConn[clientID]);
+		return(0);
+	}
+	ev.events=EPOLLOUT;
+	ev.data.u32=clientID;
+	if (epoll_ctl(_poller,EPOLL_CTL_ADD,_socketConn[clientID],&ev)!=0)
+	{
+		close(_socketConn[clientID]);
+		return(0);
+	}
+	return(1);
+}
+
+simxUChar extApi_isConnected_socket(simxInt clientID)
+{ /* return 1: the connection started with extApi_startConnectToServer_socket succeeded */
+	int error=0;
+	socklen_t length=sizeof(error);
+	if (getsockopt(_socketConn[clientID],SOL_SOCKET,SO_ERROR,&error,&length)!=0)
+		return(0);
+	return(error==0);
+}
+
+simxVoid extApi_pollSocket(simxInt clientID,simxUChar writable)
+{ /* the socket is always watched for incoming data, and for free space in its output buffer if writable!=0 */
+	struct epoll_event ev;
+	ev.events=EPOLLIN;
+	if (writable)
+		ev.events|=EPOLLOUT;
+	ev.data.u32=clientID;
+	epoll_ctl(_poller,EPOLL_CTL_MOD,_socketConn[clientID],&ev);
+}
+
+simxInt extApi_waitForSockets(simxInt* clientIDs,simxUChar* events,simxInt maxCount,simxInt timeOutInMs)
+{ /* return the number of sockets with pending events (1: readable, 2: writable, 4: error or hang up). timeOutInMs=-1 waits forever */
+	struct epoll_event ev[64];
+	uint64_t count;
+	simxInt i,n,retVal=0;
+	if (maxCount>64)
+		maxCount=64;
+	n=epoll_wait(_poller,ev,maxCount,timeOutInMs);
+	for (i=0;i<n;i++)
+	{
+		if (ev[i].data.u32==MAX_EXT_API_CONNECTIONS)
+		{ /* woken up by extApi_wakeUpPoller */
+			read(_pollerWakeUp,&count,sizeof(count));
+			continue;
+		}
+		clientIDs[retVal]=ev[i].data.u32;
+		events[retVal]=0;
+		if (ev[i].events&EPOLLIN)
+			events[retVal]|=1;
+		if (ev[i].events&EPOLLOUT)
+			events[retVal]|=2;
+		if (ev[i].events&(EPOLLERR|EPOLLHUP))
+			events[retVal]|=4;
+		retVal++;
+	}
+	return(retVal);
+}
 
+simxUChar extApi_wouldBlock()
+{ /* return 1: the last send or recv on a non-blocking socket failed only because it would have blocked */
+	return((errno==EAGAIN)||(errno==EWOULDBLOCK));
+}
+#endif
 
 #ifdef USE_ALSO_SHARED_MEMORY
 simxUChar extApi_connectToServer_sharedMem(simxInt clientID,simxInt theConnectionPort)
@@ -43,6 +43,8 @@
 #define SOCKET_MAX_PACKET_SIZE 1300 /* in bytes. Keep between 200 and 30000 */
 #define SOCKET_HEADER_LENGTH 6 /* WORD0=1 (to detect endianness), WORD1=packetSize, WORD2=packetsLeftToRead */
 #define SOCKET_TIMEOUT_READ 10000 /* in ms */
+#define SOCKET_TIMEOUT_READ_DATA 3000 /* in ms, for the data of a packet once its header is read */
+#define SOCKET_MAX_GATHER_PACKETS 64 /* packets sent with a single system call */
 
 typedef char simxChar;				/* always 1 byte */
 typedef uint8_t simxUChar;			/* always 1 byte */
@@ -74,6 +76,7 @@ simxDouble extApi_endianConversionDouble(simxDouble floatValue);
 /* Following functions might be platform specific */
 simxUChar* extApi_allocateBuffer(simxInt bufferSize);
 simxVoid extApi_releaseBuffer(simxUChar* buffer);
+simxVoid extApi_getAllocationCounters(simxInt* allocationCount,simxInt* releaseCount);
 simxVoid extApi_createMutexes(simxInt clientID);
 simxVoid extApi_deleteMutexes(simxInt clientID);
 simxVoid extApi_lockResources(simxInt clientID);
@@ -97,7 +100,22 @@ simxUChar extApi_launchThread(SIMX_THREAD_RET_TYPE (*startAddress)(simxVoid*));
 simxUChar extApi_connectToServer_socket(simxInt clientID,const simxChar* theConnectionAddress,simxInt theConnectionPort);
 simxVoid extApi_cleanUp_socket(simxInt clientID);
 simxInt extApi_send_socket(simxInt clientID,const simxUChar* data,simxInt dataLength);
+simxInt extApi_sendGather_socket(simxInt clientID,const simxUChar** chunks,const simxInt* chunkSizes,simxInt chunkCount);
 simxInt extApi_recv_socket(simxInt clientID,simxUChar* data,simxInt maxDataLength);
+simxInt extApi_recvScatter_socket(simxInt clientID,simxUChar** chunks,const simxInt* chunkSizes,simxInt chunkCount);
+
+#ifdef EXTAPI_EPOLL
+	/* Single thread servicing all the socket connections (Linux only) */
+	simxUChar extApi_tryLockSendStart(simxInt clientID);
+	simxUChar extApi_createPoller();
+	simxVoid extApi_closePoller();
+	simxVoid extApi_wakeUpPoller();
+	simxUChar extApi_startConnectToServer_socket(simxInt clientID,const simxChar* theConnectionAddress,simxInt theConnectionPort);
+	simxUChar extApi_isConnected_socket(simxInt clientID);
+	simxVoid extApi_pollSocket(simxInt clientID,simxUChar writable);
+	simxInt extApi_waitForSockets(simxInt* clientIDs,simxUChar* events,simxInt maxCount,simxInt timeOutInMs);
+	simxUChar extApi_wouldBlock();
+#endif
 
 #ifdef USE_ALSO_SHARED_MEMORY
 	simxUChar extApi_connectToServer_sharedMem(simxInt clientID,simxInt theConnectionPort);
@@ -0,0 +1,138 @@
+/**
+ * @file workload_generator.cpp
+ * @brief Implementation of the objects arrival generators
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#include "workload_generator.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+/***	MarkovWorkload	***/
+MarkovWorkload::MarkovWorkload(double mean_delay, uint32_t seed, Interarrival law) :
+	MarkovWorkload({
+		{33., 33., 34.},	// First object
+		{0., 60., 40.},		// After a type 1
+		{40., 0., 60.},		// After a type 2
+		{60., 40., 0.}		// After a type 3
+	}, mean_delay, seed, law)
+{
+}
+
+MarkovWorkload::MarkovWorkload(const vector<vector<double>>& transitions, double mean_delay, uint32_t seed, Interarrival law) :
+	transitions_(transitions),
+	mean_delay_(mean_delay),
+	law_(law),
+	engine_(seed),
+	last_type_(0)
+{
+}
+
+double MarkovWorkload::uniform() {
+	// Don't rely on the standard distributions, their implementation differ between libraries
+	return engine_() / 4294967296.;
+}
+
+bool MarkovWorkload::next(Arrival& arrival) {
+	if(last_type_ >= int(transitions_.size()))
+		return false;
+
+	const vector<double>& weights = transitions_[last_type_];
+	double total = 0.;
+	for(double weight : weights)
+		total += weight;
+	if(total <= 0.)
+		return false;
+
+	double draw = uniform() * total;
+	size_t type = 0;
+	while(type < weights.size() - 1 and draw >= weights[type]) {
+		draw -= weights[type];
+		++type;
+	}
+	last_type_ = type + 1;
+
+	switch(law_) {
+	case FixedInterarrival:
+		arrival.delay = mean_delay_;
+		break;
+	case ExponentialInterarrival:
+		arrival.delay = -log(1. - uniform()) * mean_delay_;
+		break;
+	case UniformInterarrival:
+		arrival.delay = 2. * uniform() * mean_delay_;
+		break;
+	}
+	arrival.type = last_type_;
+
+	return true;
+}
+
+/***	RoundRobinWorkload	***/
+RoundRobinWorkload::RoundRobinWorkload(double delay, int types) :
+	delay_(delay),
+	types_(std::max(types, 1)),
+	last_type_(0)
+{
+}
+
+bool RoundRobinWorkload::next(Arrival& arrival) {
+	last_type_ = last_type_ % types_ + 1;
+
+	arrival.delay = delay_;
+	arrival.type = last_type_;
+
+	return true;
+}
+
+/***	TraceWorkload	***/
+TraceWorkload::TraceWorkload(const string& file_name, bool loop) :
+	next_(0),
+	loop_(loop)
+{
+	ifstream file(file_name);
+	if(not file) {
+		cerr << "Can't open the trace file " << file_name << endl;
+		return;
+	}
+
+	string line;
+	int line_number = 0;
+	while(getline(file, line)) {
+		++line_number;
+		size_t first = line.find_first_not_of(" \t\r");
+		if(first == string::npos or line[first] == '#')
+			continue;
+
+		istringstream fields(line);
+		Arrival arrival;
+		if(fields >> arrival.delay >> arrival.type)
+			arrivals_.push_back(arrival);
+		else
+			cerr << file_name << ":" << line_number << ": invalid trace entry" << endl;
+	}
+}
+
+bool TraceWorkload::is_Loaded() const {
+	return not arrivals_.empty();
+}
+
+bool TraceWorkload::next(Arrival& arrival) {
+	if(next_ == arrivals_.size()) {
+		if(not loop_ or arrivals_.empty())
+			return false;
+		next_ = 0;
+	}
+
+	arrival = arrivals_[next_++];
+
+	return true;
+}
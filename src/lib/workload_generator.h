@@ -0,0 +1,146 @@
+/**
+ * @file workload_generator.h
+ * @brief Generators deciding when and which objects are added to the supply conveyor
+ * @author Benjamin Navarro
+ * @version 1.0.0
+ * @date 2015-10-12
+ */
+
+#ifndef WORKLOAD_GENERATOR_H_
+#define WORKLOAD_GENERATOR_H_
+
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdint>
+
+/**
+ * @brief Interface of the objects arrival generators used by the Simulator.
+ * Time only runs while the supply conveyor is moving.
+ */
+class WorkloadGenerator
+{
+public:
+	/**
+	 * @brief An object to add to the supply conveyor
+	 */
+	struct Arrival
+	{
+		double delay;	/**< Time since the previous object (or the conveyor start) before adding this one (seconds) */
+		int type;		/**< Type of the object (1 to 3) */
+	};
+
+	virtual ~WorkloadGenerator() = default;
+
+	/**
+	 * @brief Get the next object to add
+	 *
+	 * @param arrival Where to store the next object
+	 * @return false if there are no more objects to add, true otherwise
+	 */
+	virtual bool next(Arrival& arrival) = 0;
+};
+
+/**
+ * @brief Law of the time between two objects arrivals
+ */
+enum Interarrival {
+	FixedInterarrival,			/**< Always the mean delay */
+	ExponentialInterarrival,	/**< Exponentially distributed delay (Poisson arrivals) */
+	UniformInterarrival,		/**< Uniformly distributed delay between zero and twice the mean delay */
+};
+
+/**
+ * @brief Random objects types following a Markov chain. The random sequence only depends on the seed.
+ */
+class MarkovWorkload : public WorkloadGenerator
+{
+public:
+	/**
+	 * @brief Use the default transition matrix: each type is followed by a different one
+	 *
+	 * @param mean_delay Mean time between two objects (seconds)
+	 * @param seed Seed of the random number generator
+	 * @param law Law of the time between two objects
+	 */
+	MarkovWorkload(double mean_delay = 1., uint32_t seed = 1, Interarrival law = FixedInterarrival);
+
+	/**
+	 * @param transitions transitions[i][j] is the weight of type j+1 following type i, type 0 meaning no previous object.
+	 * Must have one more row than columns. The weights of a row don't have to sum to one
+	 * @param mean_delay Mean time between two objects (seconds)
+	 * @param seed Seed of the random number generator
+	 * @param law Law of the time between two objects
+	 */
+	MarkovWorkload(const std::vector<std::vector<double>>& transitions, double mean_delay = 1., uint32_t seed = 1, Interarrival law = FixedInterarrival);
+
+	virtual ~MarkovWorkload() = default;
+
+	virtual bool next(Arrival& arrival);
+
+private:
+	/**
+	 * @brief Get a random number uniformly distributed in [0,1[, identical on all platforms for a given seed
+	 */
+	double uniform();
+
+	std::vector<std::vector<double>> transitions_;
+	double mean_delay_;
+	Interarrival law_;
+	std::mt19937 engine_;
+	int last_type_;
+};
+
+/**
+ * @brief Objects types in turn (1, 2, 3, 1, ...) at a fixed rate
+ */
+class RoundRobinWorkload : public WorkloadGenerator
+{
+public:
+	/**
+	 * @param delay Time between two objects (seconds)
+	 * @param types Number of objects types, at least one
+	 */
+	RoundRobinWorkload(double delay = 1., int types = 3);
+
+	virtual ~RoundRobinWorkload() = default;
+
+	virtual bool next(Arrival& arrival);
+
+private:
+	double delay_;
+	int types_;
+	int last_type_;
+};
+
+/**
+ * @brief Replay the objects listed in a trace file.
+ * Each line holds the delay since the previous object (seconds) and the type of the object. Empty lines and lines starting with '#' are ignored.
+ */
+class TraceWorkload : public WorkloadGenerator
+{
+public:
+	/**
+	 * @param file_name Path to the trace file
+	 * @param loop Restart from the beginning at the end of the trace
+	 */
+	TraceWorkload(const std::string& file_name, bool loop = false);
+
+	virtual ~TraceWorkload() = default;
+
+	/**
+	 * @brief Tell if the trace file has been read successfully
+	 *
+	 * @return true if the trace holds at least one object, false otherwise
+	 */
+	bool is_Loaded() const;
+
+	virtual bool next(Arrival& arrival);
+
+private:
+	std::vector<Arrival> arrivals_;
+	size_t next_;
+	bool loop_;
+};
+
+#endif
@@ -0,0 +1,37 @@
+-- Packed protocol bridge, to be used with the Simulator::PackedProtocol option.
+-- Attach it as a non-threaded child script to any object of SceneVREP.ttt.
+--
+-- Commands: the "commands" integer signal is a bitmask (bit i = Simulator::Command i)
+-- expanded here into the individual command signals used by the scene scripts.
+-- Sensors: the individual sensor signals are packed into the "sensors" string
+-- signal (9 little endian 32 bits integers, same order as Simulator::sensors_t).
+
+if (sim_call_type==sim_childscriptcall_initialization) then
+	commandNames={'appro_conveyor_command','evac_conveyor_command','reccam','go_right','go_left','take','put_down','OP1','OP2','OP3','verif'}
+	sensorNames={'optical_barrier_state','gripper_closed','current_position','evac_conveyor_stopped','end_identification','box_type','end_operation','assembly_ok','assembly_evacuated'}
+	lastCommands=-1
+end
+
+if (sim_call_type==sim_childscriptcall_actuation) then
+	local commands=simGetIntegerSignal('commands')
+	if (commands and commands~=lastCommands) then
+		for i=1,#commandNames,1 do
+			local bit=math.floor(commands/(2^(i-1)))%2
+			simSetIntegerSignal(commandNames[i],bit)
+		end
+		lastCommands=commands
+	end
+end
+
+if (sim_call_type==sim_childscriptcall_sensing) then
+	local sensors={}
+	for i=1,#sensorNames,1 do
+		sensors[i]=simGetIntegerSignal(sensorNames[i]) or 0
+	end
+	simSetStringSignal('sensors',simPackInts(sensors))
+end
+
+if (sim_call_type==sim_childscriptcall_cleanup) then
+	simClearIntegerSignal('commands')
+	simClearStringSignal('sensors')
+end